@@ -1,4 +1,5 @@
 #include "fluidSimulator.h"
+#include "headlessSimulator.h"
 
 // SDl workaround...
 #include <SDL.h>
@@ -10,10 +11,11 @@ constexpr auto GLSL_VERSION = "#version 130";
 
 namespace Application {
 
-    FluidSimulator::FluidSimulator() : windowSize(1500, 750),
+    FluidSimulator::FluidSimulator(bool GLInterop) : windowSize(1500, 750),
                                        simType(Physics::SimType::POSITION_BASED_FLUIDS),
                                        appName("Realtime Fluid Simulator"),
                                        init(false),
+                                       GLInterop(GLInterop),
                                        backGroundColor(0.0f, 0.0f, 0.0f, 1.00f) {
         LOG_INFO("Starting a RT physicaly accurate fluid simulator !");
 
@@ -130,12 +132,13 @@ namespace Application {
         params.maxNbParticles = Utils::ALL_NB_PARTICLES.crbegin()->first;
         params.boxSize = Utils::BOX_SIZE;
         params.gridRes = Utils::GRID_RES;
-        params.TSDFGridRes = params.gridRes * 3;
+        params.TSDFGridRes = Utils::TSDF_GRID_RES;
         params.velocity = 1.0f;
         params.particlePosVBO = (unsigned int) graphicsEngine->getPointCloudCoordVBO();
         params.particleColVBO = (unsigned int) graphicsEngine->getPointCloudColorVBO();
         params.cameraVBO = (unsigned int) graphicsEngine->getCameraCoordVBO();
         params.gridVBO = (unsigned int) graphicsEngine->getGridDetectorVBO();
+        params.GLInterop = GLInterop;
 
         if (physicsEngine) {
             LOG_DEBUG("Physics engine already existing, resetting it");
@@ -208,10 +211,25 @@ namespace Application {
             glClearColor(backGroundColor.x, backGroundColor.y, backGroundColor.z, backGroundColor.w);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+            // Shared buffers may still be used by the last rendering, waiting for it on the device if possible
+            if (!physicsEngine->setRenderFence(graphicsEngine->getRenderFence()))
+                graphicsEngine->waitForRendering();
+
             // Make the simulation happen
+            physicsEngine->setCameraPos(graphicsEngine->cameraPos());
             physicsEngine->update();
 
-            graphicsEngine->setNbParticles((int)physicsEngine->nbParticles());
+            if (physicsEngine->isGLInteropEnabled()) {
+                graphicsEngine->setNbParticles((int)physicsEngine->nbParticles());
+            } else {
+                // Output of the previous update, nothing is drawn until the first copy is there
+                Physics::RenderData renderData;
+                if (physicsEngine->getRenderData(renderData)) {
+                    graphicsEngine->loadPointCloud(renderData.pos, renderData.col, renderData.nbParticles);
+                    graphicsEngine->loadGridDetector(renderData.gridDetector, renderData.gridDetectorSize);
+                }
+                graphicsEngine->setNbParticles((int)renderData.nbParticles);
+            }
 
             // Draw all on screen
             graphicsEngine->draw();
@@ -362,8 +380,42 @@ namespace Application {
     }
 }
 
-int main() {
-    Application::FluidSimulator ourSimulation;
+int main(int argc, char *argv[]) {
+    // Usage: mainSimulator [--no-interop | --headless [nbFrames] [--profile] [--out-of-order] [--autotune] [--onesweep] [--sort-benchmark]]
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        size_t nbFrames = 1000;
+        bool profile = false;
+        bool outOfOrder = false;
+        bool autotune = false;
+        bool onesweep = false;
+        bool sortBenchmark = false;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--profile")
+                profile = true;
+            else if (arg == "--out-of-order")
+                outOfOrder = true;
+            else if (arg == "--autotune")
+                autotune = true;
+            else if (arg == "--onesweep")
+                onesweep = true;
+            else if (arg == "--sort-benchmark")
+                sortBenchmark = true;
+            else
+                nbFrames = std::stoul(arg);
+        }
+        Application::HeadlessSimulator headlessSimulation(nbFrames, profile, outOfOrder, autotune, onesweep, sortBenchmark);
+
+        if (headlessSimulation.isInit()) {
+            headlessSimulation.run();
+        }
+
+        return 0;
+    }
+
+    // Forces the copy through the host, as if no device could share buffers with OpenGL
+    const bool GLInterop = !(argc > 1 && std::string(argv[1]) == "--no-interop");
+    Application::FluidSimulator ourSimulation(GLInterop);
 
     if (ourSimulation.isInit()) {
         ourSimulation.run();
@@ -27,7 +27,7 @@ namespace Application {
 
     public:
         // Constructor & destructors
-        FluidSimulator();
+        explicit FluidSimulator(bool GLInterop = true);
 
         ~FluidSimulator();
 
@@ -72,5 +72,7 @@ namespace Application {
         std::string appName;
 
         bool init;
+        // Share the VBOs with OpenCL when possible
+        bool GLInterop;
     };
 }
\ No newline at end of file
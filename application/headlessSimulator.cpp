@@ -0,0 +1,99 @@
+#include "headlessSimulator.h"
+
+#include <chrono>
+
+namespace Application {
+
+    HeadlessSimulator::HeadlessSimulator(size_t nbFrames, bool profile, bool outOfOrder, bool autotune, bool onesweep,
+                                         bool sortBenchmark)
+            : nbFrames(nbFrames),
+              profile(profile),
+              outOfOrder(outOfOrder),
+              autotune(autotune),
+              onesweep(onesweep),
+              sortBenchmark(sortBenchmark),
+              init(false) {
+        LOG_INFO("Starting a headless fluid simulator for {} frames", nbFrames);
+
+        if (!initPhysicsEngine()) {
+            LOG_ERROR("Failed to init physics Engine !");
+            return;
+        }
+
+        init = true;
+    }
+
+    HeadlessSimulator::~HeadlessSimulator() {
+        LOG_INFO("Quitting headless fluid simulator");
+    }
+
+    bool HeadlessSimulator::initPhysicsEngine() {
+        Physics::ModelParams params;
+        params.maxNbParticles = Utils::ALL_NB_PARTICLES.crbegin()->first;
+        params.boxSize = Utils::BOX_SIZE;
+        params.gridRes = Utils::GRID_RES;
+        params.TSDFGridRes = Utils::TSDF_GRID_RES;
+        params.velocity = 1.0f;
+        params.headless = true;
+        params.outOfOrderQueue = outOfOrder;
+        params.autotune = autotune;
+
+        auto fluids = std::make_unique<Physics::PositionBasedFluids>(params);
+
+        if (!fluids || !fluids->isInit()) {
+            LOG_ERROR("Physic engine not runnig !");
+            return false;
+        }
+
+        if (onesweep) {
+            fluids->setRadixSortBackend(Physics::RadixSort::Backend::ONESWEEP);
+        }
+
+        physicsEngine = std::move(fluids);
+
+        physicsEngine->enableProfiling(profile);
+
+        const auto memory = physicsEngine->getMemoryReport();
+        LOG_INFO("Device memory used {} MB (peak {} MB) out of a budget of {} MB", memory.totalBytes >> 20,
+                 memory.peakBytes >> 20, memory.budgetBytes >> 20);
+        for (const auto &[owner, bytes]: memory.owners) {
+            LOG_INFO("  {} : {} KB", owner, bytes >> 10);
+        }
+
+        return true;
+    }
+
+    void HeadlessSimulator::run() {
+        LOG_INFO("Start headless RUN function");
+
+        physicsEngine->finishTasks();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t frame = 0; frame < nbFrames; ++frame) {
+            physicsEngine->update();
+        }
+
+        physicsEngine->finishTasks();
+        const auto end = std::chrono::steady_clock::now();
+
+        const double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+        const double frameMs = nbFrames > 0 ? totalMs / (double) nbFrames : 0.0;
+        LOG_INFO("Simulated {} frames of {} particles in {} ms ({} ms per frame)", nbFrames,
+                 physicsEngine->nbParticles(), totalMs, frameMs);
+
+        const auto argStats = physicsEngine->getKernelArgStats();
+        LOG_INFO("Kernel args of the last frame : {} set, {} skipped as identical", argStats.nbSet, argStats.nbElided);
+
+        for (const auto &stats: physicsEngine->getKernelStats()) {
+            LOG_INFO("Kernel {} : min {} ms, mean {} ms, max {} ms, {} ms per frame", stats.name, stats.minMs,
+                     stats.meanMs, stats.maxMs, stats.msPerFrame);
+        }
+
+        if (sortBenchmark) {
+            auto *fluids = dynamic_cast<Physics::PositionBasedFluids *>(physicsEngine.get());
+            if (fluids) {
+                fluids->benchmarkRadixSort(100);
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <memory>
+
+// My libs
+#include "Logger.h"
+#include "Params.h"
+#include "BasePhysicModel.h"
+#include "PositionBasedFluids.h"
+
+namespace Application {
+
+    // Run the simulation without any window or GL driver, as a batch workload
+    class HeadlessSimulator {
+
+    public:
+        HeadlessSimulator(size_t nbFrames, bool profile, bool outOfOrder, bool autotune, bool onesweep, bool sortBenchmark);
+
+        ~HeadlessSimulator();
+
+        // Main loop
+        void run();
+
+        bool isInit() const { return init; }
+
+    private:
+        bool initPhysicsEngine();
+
+        size_t nbFrames;
+        bool profile;
+        bool outOfOrder;
+        bool autotune;
+        bool onesweep;
+        // Both radix sort backends are timed after the run
+        bool sortBenchmark;
+
+        std::unique_ptr<Physics::BasePhysicModel> physicsEngine;
+
+        bool init;
+    };
+}
@@ -65,5 +65,99 @@ void UI::PhysicsControls::display() {
         positionBasedFluidSim->enableVorticityConfinement(isVorticityConfinementEnabled);
     }
 
+    // Opt-in only, its look-back may hang on devices which do not schedule work groups fairly
+    if (positionBasedFluidSim->isOnesweepSortSupported())
+    {
+        bool isOnesweepSortEnabled = positionBasedFluidSim->getRadixSortBackend() == Physics::RadixSort::Backend::ONESWEEP;
+        if (ImGui::Checkbox("Onesweep radix sort", &isOnesweepSortEnabled))
+        {
+            positionBasedFluidSim->setRadixSortBackend(isOnesweepSortEnabled ? Physics::RadixSort::Backend::ONESWEEP
+                                                                             : Physics::RadixSort::Backend::MULTI_PASS);
+        }
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Profiling");
+    ImGui::Spacing();
+
+    bool isProfilingEnabled = physicsEngine->isProfilingEnabled();
+    if (ImGui::Checkbox("Enable kernel profiling", &isProfilingEnabled))
+    {
+        physicsEngine->enableProfiling(isProfilingEnabled);
+    }
+
+    const auto argStats = physicsEngine->getKernelArgStats();
+    ImGui::Text("Kernel args per frame: %zu set, %zu skipped", argStats.nbSet, argStats.nbElided);
+
+    if (isProfilingEnabled && ImGui::BeginTable("Kernel timings", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Kernel");
+        ImGui::TableSetupColumn("Min (ms)");
+        ImGui::TableSetupColumn("Mean (ms)");
+        ImGui::TableSetupColumn("Max (ms)");
+        ImGui::TableSetupColumn("Per frame (ms)");
+        ImGui::TableHeadersRow();
+
+        for (const auto& stats : physicsEngine->getKernelStats())
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(stats.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.minMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.meanMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.maxMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.msPerFrame);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Device memory");
+    ImGui::Spacing();
+
+    const auto memory = physicsEngine->getMemoryReport();
+    constexpr float MB = 1024.0f * 1024.0f;
+    ImGui::Text("Used %.1f MB, peak %.1f MB", (float) memory.totalBytes / MB, (float) memory.peakBytes / MB);
+    ImGui::Text("Budget %.1f MB, headroom %.1f MB, device %.1f MB", (float) memory.budgetBytes / MB,
+                (float) memory.headroomBytes() / MB, (float) memory.deviceBytes / MB);
+    ImGui::ProgressBar(memory.budgetBytes > 0 ? (float) memory.totalBytes / (float) memory.budgetBytes : 0.0f);
+
+    for (const auto& [owner, bytes] : memory.owners)
+        ImGui::Text("%s: %.2f MB", owner.c_str(), (float) bytes / MB);
+
+    if (ImGui::TreeNode("Buffers"))
+    {
+        if (ImGui::BeginTable("Device buffers", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Buffer");
+            ImGui::TableSetupColumn("Owner");
+            ImGui::TableSetupColumn("Kind");
+            ImGui::TableSetupColumn("Size (KB)");
+            ImGui::TableHeadersRow();
+
+            for (const auto& buffer : memory.buffers)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if (buffer.aliasGroup.empty())
+                    ImGui::TextUnformatted(buffer.name.c_str());
+                else
+                    ImGui::Text("%s (%s)", buffer.name.c_str(), buffer.aliasGroup.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(buffer.owner.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(buffer.kind.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", (float) buffer.bytes / 1024.0f);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::TreePop();
+    }
+
     ImGui::End();
 }
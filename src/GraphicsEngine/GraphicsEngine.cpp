@@ -6,6 +6,7 @@
 // for a overview of steps: https://graphicscompendium.com/opengl/09-opengl-intro
 
 
+#include <algorithm>
 #include <array>
 #include <vector>
 #include "GraphicsEngine.h"
@@ -42,6 +43,8 @@ Render::GraphicsEngine::GraphicsEngine(Render::EngineParams params) : nbMaxParti
 }
 
 Render::GraphicsEngine::~GraphicsEngine() {
+    glDeleteSync(renderFence);
+    glDeleteSync(previousRenderFence);
     glDeleteBuffers(1, &pointCloudCoordVBO);
     glDeleteBuffers(1, &pointCloudColorVBO);
     glDeleteBuffers(1, &boxVBO);
@@ -49,9 +52,9 @@ Render::GraphicsEngine::~GraphicsEngine() {
 }
 
 void Render::GraphicsEngine::buildShaders() {
-    pointCloudShader = std::make_unique<Shader>("./GLSL/PointCloudVertShader.glsl", "./GLSL/PointCloudFragShader.glsl");
-    boxShader = std::make_unique<Shader>("./GLSL/BoxVertShader.glsl", "./GLSL/FragShader.glsl");
-    gridShader = std::make_unique<Shader>("./GLSL/GridVertShader.glsl", "./GLSL/FragShader.glsl");
+    pointCloudShader = std::make_unique<Shader>("PointCloudVertShader.glsl", "PointCloudFragShader.glsl");
+    boxShader = std::make_unique<Shader>("BoxVertShader.glsl", "FragShader.glsl");
+    gridShader = std::make_unique<Shader>("GridVertShader.glsl", "FragShader.glsl");
 }
 
 void Render::GraphicsEngine::initCamera(float sceneAspectRation) {
@@ -233,8 +236,44 @@ void Render::GraphicsEngine::draw() {
 
     drawPointCloud();
 
+    // No host wait here, the simulation waits for this fence before using the shared buffers again
+    glDeleteSync(previousRenderFence);
+    previousRenderFence = renderFence;
+    renderFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
     glFlush();
-    glFinish();
+}
+
+void Render::GraphicsEngine::waitForRendering() const {
+    if (renderFence == nullptr)
+        return;
+
+    // Commands have been flushed with the fence, it will be signaled
+    while (glClientWaitSync(renderFence, 0, 1000000) == GL_TIMEOUT_EXPIRED) {
+    }
+}
+
+void Render::GraphicsEngine::loadPointCloud(const void *pos, const void *col, size_t nbParticles) {
+    if (pos == nullptr || col == nullptr)
+        return;
+
+    const auto size = (GLsizeiptr) (4 * std::min(nbParticles, nbMaxParticules) * sizeof(float));
+
+    // Data is copied on call, host memory can be reused on return
+    glBindBuffer(GL_ARRAY_BUFFER, pointCloudCoordVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, pos);
+    glBindBuffer(GL_ARRAY_BUFFER, pointCloudColorVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, col);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Render::GraphicsEngine::loadGridDetector(const void *gridDetector, size_t size) {
+    if (gridDetector == nullptr)
+        return;
+
+    const size_t numCells = gridResolution * gridResolution * gridResolution;
+    glBindBuffer(GL_ARRAY_BUFFER, gridDetectorVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) std::min(size, 8 * numCells * sizeof(float)), gridDetector);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Render::GraphicsEngine::drawBox() const {
@@ -37,6 +37,17 @@ namespace Render {
 
         void draw();
 
+        // Signaled once the last draw is done with the buffers shared with OpenCL, null before the first draw
+        [[nodiscard]] inline GLsync getRenderFence() const { return renderFence; }
+
+        // Host wait on the render fence, for when OpenCL cannot wait for it on the device
+        void waitForRendering() const;
+
+        // Without CL-GL sharing, simulation output is uploaded from host memory instead of being written by OpenCL
+        void loadPointCloud(const void *pos, const void *col, size_t nbParticles);
+
+        void loadGridDetector(const void *gridDetector, size_t size);
+
         // Getter
         [[nodiscard]] inline Math::float3 cameraPos() const {
             return camera ? camera->cameraPos() : Math::float3(0.0f, 0.0f, 0.0f);
@@ -144,6 +155,10 @@ namespace Render {
         GLuint gridEBO;
         GLuint gridPosVBO;
 
+        // Previous fence may still be waited for by OpenCL, it is only deleted one frame later
+        GLsync renderFence{nullptr};
+        GLsync previousRenderFence{nullptr};
+
 
         typedef std::array<float, 3> Vertex;
         // Cube geometry for rendering
@@ -2,17 +2,19 @@
 // Created by charl on 6/11/2023.
 //
 
-#include <fstream>
 #include "Shader.h"
+#include "EmbeddedSources.h"
 #include "Logger.h"
 
-Render::Shader::Shader(const char *vertSrcFile, const char *fragSrcFile) {
+#include <vector>
+
+Render::Shader::Shader(const char *vertSrcName, const char *fragSrcName) {
     // for creation and compile step please refer to : https://www.khronos.org/opengl/wiki/Shader_Compilation
     programID = glCreateProgram();
 
-    // Read shaders from disk
-    std::string vertShaderStr = readFromFile(vertSrcFile);
-    std::string fragShaderStr = readFromFile(fragSrcFile);
+    // Shaders sources are embedded in the executable
+    std::string vertShaderStr = loadSource(vertSrcName);
+    std::string fragShaderStr = loadSource(fragSrcName);
 
     // Compile loader shaders
     compileShader(GL_VERTEX_SHADER, vertShaderStr.c_str());
@@ -68,24 +70,13 @@ void Render::Shader::compileShader(GLenum type, const char *source) const {
     glDeleteShader(shaderID);
 }
 
-const std::string Render::Shader::readFromFile(const char *pathToFile) {
-    std::string content;
-    std::ifstream fileStream(pathToFile, std::ios::in);
-
-    if (!fileStream.is_open()) {
-        std::string path(pathToFile);
-        LOG_ERROR("Could not load shader from : " + path +
-                  " file does not exist (you may need to copy files to a folder called GLSL, next to the executable)");
-        return "";
-    }
+const std::string Render::Shader::loadSource(const char *sourceName) {
+    std::string content = Utils::LoadSource(sourceName);
 
-    std::string line = "";
-    while (!fileStream.eof()) {
-        std::getline(fileStream, line);
-        content.append(line + "\n");
+    if (content.empty()) {
+        LOG_ERROR("Could not load shader {}, it is not embedded in the executable", sourceName);
     }
 
-    fileStream.close();
     return content;
 }
 
@@ -10,7 +10,8 @@
 namespace Render {
     class Shader {
     public:
-        Shader(const char *vertSrcFile, const char *fragSrcFile);
+        // Names of embedded shader sources, ex: "FragShader.glsl"
+        Shader(const char *vertSrcName, const char *fragSrcName);
 
         ~Shader();
 
@@ -29,7 +30,7 @@ namespace Render {
         GLint getUniformLocation(const std::string& name) const;
 
         // Shader Compiler see : https://www.khronos.org/opengl/wiki/Shader_Compilation
-        const std::string readFromFile(const char* pathToFile);
+        const std::string loadSource(const char* sourceName);
         void compileShader(GLenum type, const char* source) const;
 
         GLint programID;
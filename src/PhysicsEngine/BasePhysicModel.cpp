@@ -8,6 +8,7 @@
 
 Physics::BasePhysicModel::BasePhysicModel(ModelParams params) : init(false),
                                                                 pause(false),
+                                                                headless(params.headless),
                                                                 useMesher(true),
                                                                 maxNbParticles(params.maxNbParticles),
                                                                 currNbParticles(params.currNbParticles),
@@ -16,26 +17,57 @@ Physics::BasePhysicModel::BasePhysicModel(ModelParams params) : init(false),
                                                                         params.gridRes),
                                                                 velocity(params.velocity),
                                                                 boundary(Boundary::BouncingWall),
+                                                                cameraPos(0.0f, 0.0f, 0.0f),
                                                                 particlePosVBO(params.particlePosVBO),
                                                                 particleColVBO(params.particleColVBO),
                                                                 cameraVBO(params.cameraVBO),
-                                                                gridVBO(params.gridVBO) {}
-
-Physics::BasePhysicModel::~BasePhysicModel() {
-    CL::Context::Get().release();
+                                                                gridVBO(params.gridVBO) {
+    CL::contextSpecs specs;
+    specs.headless = params.headless;
+    specs.GLInterop = params.GLInterop;
+    specs.deviceName = params.deviceName;
+    specs.outOfOrderQueue = params.outOfOrderQueue;
+    specs.memoryBudget = params.memoryBudget;
+    specs.autotune = params.autotune;
+    context = std::make_unique<CL::Context>(specs);
 }
 
+// Context releases everything it created when destroyed
+Physics::BasePhysicModel::~BasePhysicModel() = default;
+
 bool Physics::BasePhysicModel::isProfilingEnabled() const {
-    CL::Context& clContext = Physics::CL::Context::Get();
-    return clContext.isProfiling();
+    return context->isProfiling();
 }
 
 void Physics::BasePhysicModel::enableProfiling(bool enable) {
-    CL::Context& clContext = Physics::CL::Context::Get();
-    clContext.enableProfiler(enable);
+    context->enableProfiler(enable);
+}
+
+std::vector<Physics::CL::kernelStats> Physics::BasePhysicModel::getKernelStats() const {
+    return context->getKernelStats();
+}
+
+Physics::CL::kernelArgStats Physics::BasePhysicModel::getKernelArgStats() const {
+    return context->getKernelArgStats();
+}
+
+Physics::CL::memoryReport Physics::BasePhysicModel::getMemoryReport() const {
+    return context->getMemoryReport();
+}
+
+void Physics::BasePhysicModel::finishTasks() const {
+    context->finishTasks();
+}
+
+bool Physics::BasePhysicModel::setRenderFence(void *GLFence) {
+    return context->setGLFence(static_cast<cl_GLsync>(GLFence));
+}
+
+bool Physics::BasePhysicModel::isGLInteropEnabled() const {
+    return context->isGLInteropEnabled();
 }
 
 bool Physics::BasePhysicModel::isUsingIGPU() const {
-    const std::string& platformName = Physics::CL::Context::Get().getPlatformName();
+    const std::string& platformName = context->getPlatformName();
     return (platformName.find("Intel") != std::string::npos);
 }
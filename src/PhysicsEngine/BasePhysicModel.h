@@ -5,12 +5,20 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "Math.hpp"
+#include "ocl/KernelStats.hpp"
+#include "ocl/MemoryStats.hpp"
 
 
 namespace Physics {
 
+    namespace CL {
+        class Context;
+    }
+
     // Implemented simulation models
     enum SimType {
         POSITION_BASED_FLUIDS = 0,
@@ -41,6 +49,27 @@ namespace Physics {
         unsigned int particleColVBO = 0;
         unsigned int cameraVBO = 0;
         unsigned int gridVBO = 0;
+        // Run without any window, buffers shared with OpenGL are replaced by plain OpenCL ones
+        bool headless = false;
+        // Share the VBOs with OpenCL if the device allows it, copy the simulation output to them through the host otherwise
+        bool GLInterop = true;
+        // Run on the first device whose name contains it, empty for the default device
+        std::string deviceName;
+        // Let independent kernels overlap on the device, if supported
+        bool outOfOrderQueue = false;
+        // Device memory allowed for buffers in bytes, 0 for the whole device memory
+        size_t memoryBudget = 0;
+        // Benchmark work-group sizes of kernels not tuned yet on this device, results are kept for later runs
+        bool autotune = false;
+    };
+
+    // Host copy of the buffers to render, used when they cannot be shared with OpenGL
+    struct RenderData {
+        const void *pos = nullptr;
+        const void *col = nullptr;
+        size_t nbParticles = 0;
+        const void *gridDetector = nullptr;
+        size_t gridDetectorSize = 0;
     };
 
     // This hold the type of limit conditions used for the simulation
@@ -87,11 +116,40 @@ namespace Physics {
 
         void enableProfiling(bool enable);
 
+        // Per kernel timings over the last profiled frames, empty if profiling is disabled
+        [[nodiscard]] std::vector<CL::kernelStats> getKernelStats() const;
+
+        // Kernel arg bindings done and skipped as identical during the last update
+        [[nodiscard]] CL::kernelArgStats getKernelArgStats() const;
+
+        // Device memory used by each buffer and owner, against the device memory budget
+        [[nodiscard]] CL::memoryReport getMemoryReport() const;
+
+        // Wait for all the work sent to the device to be done
+        void finishTasks() const;
+
+        // GL fence (GLsync) of the last rendering, next update waits for it on the device.
+        // False if the device cannot, the caller has to wait for the rendering itself
+        bool setRenderFence(void *GLFence);
+
+        // False if the VBOs are not shared with OpenCL, rendered data then comes from getRenderData
+        [[nodiscard]] bool isGLInteropEnabled() const;
+
+        // Simulation output copied to the host by the update before the last one, false if there is none yet
+        virtual bool getRenderData(RenderData &data) { return false; }
+
+        // Only needed without GL sharing, the camera VBO is read directly otherwise
+        void setCameraPos(const Math::float3 &pos) { cameraPos = pos; }
+
         bool isUsingIGPU() const;
 
     protected:
+        // Owned by the model, several simulations can run side by side, possibly on different devices
+        std::unique_ptr<CL::Context> context;
+
         bool init;
         bool pause;
+        bool headless;
         bool useMesher;
 
         size_t maxNbParticles;
@@ -106,6 +164,8 @@ namespace Physics {
 
         Boundary boundary;
 
+        Math::float3 cameraPos;
+
         // Used to bridge to graphics
         unsigned int particlePosVBO;
         unsigned int particleColVBO;
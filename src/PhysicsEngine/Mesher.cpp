@@ -25,17 +25,17 @@
 // Compute TSDF
 #define KERNEL_TSDF_COMPUTE "TSDF_computeGrid"
 
-Physics::Mesher::Mesher(size_t TSDFGridRes, size_t nbPqrticules, size_t domainSize, size_t maxnbParticules,
-                        RadixSort *radixSort1)
-        : simDomainSize(domainSize),
+Physics::Mesher::Mesher(CL::Context &context, size_t TSDFGridRes, size_t domainSize,
+                        size_t maxnbParticules, RadixSort *radixSort1)
+        : context(context),
+          simDomainSize(domainSize),
           init(false),
-          nbMaxPartPerCellTSDF(100),
+          nbMaxPartPerCellTSDF(MESHER_NUM_MAX_PARTS_IN_CELL),
           maxNbParticules(maxnbParticules),
           nbTSDFGridCells(
                   TSDFGridRes * TSDFGridRes *
                   TSDFGridRes),
           TSDFGridRes(TSDFGridRes),
-          nbParticules(nbPqrticules),
           radixSort(radixSort1) {
 
     // create openCl program
@@ -50,74 +50,66 @@ Physics::Mesher::Mesher(size_t TSDFGridRes, size_t nbPqrticules, size_t domainSi
         return;
     }
 
-    // create openCL kernels
-    if (!createKernels()) {
-        LOG_ERROR("Couldn't create openCL kernels");
-        return;
-    }
-
-    init = true;
+    // openCL kernels are created later by the owner, once every other program build has been started
 }
 
 bool Physics::Mesher::createOpenCLProgram() const {
-    CL::Context &clContext = CL::Context::Get();
+    CL::Context &clContext = context;
 
     std::ostringstream clBuildOptions;
 
+    // BOX_SIZE                 - Size of the simulation domain
     // TSDF_GRID_RES            - TSDF grid resolution
-    // TSDF_GRID_CELL_SIZE      - TSDF size of a cell
-    // TSDF_GRID_NUM_CELLS      - TSDF grid number of cells
-    // ABS_WALL_POS             - Absolute position of the walls in x,y,z
     // TSDF_NUM_MAX_PARTS_IN_CELL   - maximum number of particles taking into
     // account in a single cell in simplified mode
+    // Cell size, number of cells and wall position are derived from them in mesher.cl
+    clBuildOptions << " -DBOX_SIZE=" << simDomainSize;
     clBuildOptions << " -DTSDF_GRID_RES=" << TSDFGridRes;
-    clBuildOptions << " -DTSDF_GRID_CELL_SIZE=" << Utils::FloatToStr((float) simDomainSize / TSDFGridRes);;
-    clBuildOptions << " -DTSDF_GRID_NUM_CELLS=" << nbTSDFGridCells;
-    clBuildOptions << " -DABS_WALL_POS=" << Utils::FloatToStr((float) simDomainSize / 2.0f);
     clBuildOptions << " -DTSDF_NUM_MAX_PARTS_IN_CELL=" << nbMaxPartPerCellTSDF;
 
     LOG_INFO(clBuildOptions.str());
     LOG_INFO("Creating OpenCL Program for TSDF program");
 
-    if (!clContext.createProgram(PROGRAM_MESHER, "mesher.cl", clBuildOptions.str())) {
-        return false;
-    }
-    return true;
+    return clContext.createProgram(PROGRAM_MESHER, "mesher.cl", clBuildOptions.str()).valid();
 }
 
-bool Physics::Mesher::createBuffers() const {
-    CL::Context &clContext = CL::Context::Get();
+bool Physics::Mesher::createBuffers() {
+    CL::Context &clContext = context;
 
     LOG_INFO("Creating OpenCL Buffers for TSDF program");
     // Buffer to hold our TSDF voxel grid (an array of signed float, distance to nearest surface)
-    clContext.createBuffer("TSDFGrid", sizeof(float) * nbTSDFGridCells, CL_MEM_READ_WRITE);
+    buffers.grid = clContext.createBuffer("TSDFGrid", sizeof(float) * nbTSDFGridCells, CL_MEM_READ_WRITE, "Mesher");
     // Buffer to hold a tab with pCellID[ID] = id of the cell in TSDF grid the ID particule is in
-    clContext.createBuffer("TSDF_cellID", sizeof(unsigned int) * maxNbParticules, CL_MEM_READ_WRITE);
+    buffers.cellID = clContext.createBuffer("TSDF_cellID", sizeof(unsigned int) * maxNbParticules, CL_MEM_READ_WRITE, "Mesher");
 
     // Hold start and end ID of particule in a cell of the grid, sorted by radix and use later for NN search
     // Also used in TSDF to create mesh
-    clContext.createBuffer("TSDF_part_startEndID", 2 * sizeof(unsigned int) * nbTSDFGridCells, CL_MEM_READ_WRITE);
+    buffers.partStartEndID = clContext.createBuffer("TSDF_part_startEndID", 2 * sizeof(unsigned int) * nbTSDFGridCells, CL_MEM_READ_WRITE, "Mesher");
 
-    // Buffer to hold all particules positions
-    clContext.createBuffer("TSDF_part_pos_tmp", 4 * sizeof(float) * maxNbParticules, CL_MEM_READ_WRITE);
+    // Particles positions are not copied, they are read in place through the sorted indices
 
     LOG_INFO("OpenCL Buffers have been created properly");
     return true;
 }
 
 bool Physics::Mesher::createKernels() {
+    CL::Context &clContext = context;
+
+    kernels.resetCellID = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_RESET_CELL_ID, {"TSDF_cellID"});
+    kernels.fillCellID = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_CELL_ID, {"", "TSDF_cellID"});
+    kernels.resetStartEndCell = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_RESET_START_END_CELL, {"TSDF_part_startEndID"});
+    kernels.fillStartCell = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_START_CELL, {"TSDF_cellID", "TSDF_part_startEndID"});
+    kernels.fillEndCell = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_END_CELL, {"TSDF_cellID", "TSDF_part_startEndID"});
+    kernels.adjustEndCell = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_ADJUST_END_CELL, {"TSDF_part_startEndID"});
+    kernels.computeGrid = clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_COMPUTE,
+                                                 {"TSDF_cellID", "TSDF_part_startEndID", "", "", "TSDFGrid"});
+    if (!kernels.computeGrid.isValid()) {
+        LOG_ERROR("Couldn't create openCL kernels");
+        return false;
+    }
 
-    CL::Context &clContext = CL::Context::Get();
-
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_RESET_CELL_ID, {"TSDF_cellID"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_CELL_ID, {"TSDF_cellID", "TSDF_part_pos_tmp"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_RESET_START_END_CELL, {"TSDF_part_startEndID"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_START_CELL, {"TSDF_cellID", "TSDF_part_startEndID"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_FILL_END_CELL, {"TSDF_cellID", "TSDF_part_startEndID"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_ADJUST_END_CELL, {"TSDF_part_startEndID"});
-    clContext.createKernel(PROGRAM_MESHER, KERNEL_TSDF_COMPUTE,
-                           {"TSDF_cellID", "TSDF_part_startEndID", "TSDF_part_pos_tmp", "TSDFGrid"});
     LOG_INFO("Properly initiated OpenCl kernels");
+    init = true;
     return true;
 }
 
@@ -127,8 +119,8 @@ void Physics::Mesher::reset() const {
         return;
     }
 
-    CL::Context &clContext = CL::Context::Get();
-    clContext.runKernel(KERNEL_TSDF_RESET_CELL_ID, {maxNbParticules});
+    CL::Context &clContext = context;
+    clContext.runKernel(kernels.resetCellID, {maxNbParticules});
 }
 
 /*********************************************************************/
@@ -139,26 +131,27 @@ void Physics::Mesher::reset() const {
 /*********************************************************************/
 /*********************************************************************/
 
-void Physics::Mesher::updateMesher(const std::string& inputPartPos) {
+void Physics::Mesher::updateMesher(CL::BufferHandle inputPartPos, size_t nbParticles) {
     // Will use particules postions to compute TSDF
 
-    CL::Context &clContext = CL::Context::Get();
-
-    clContext.copyBuffer(inputPartPos, "TSDF_part_pos_tmp");
+    CL::Context &clContext = context;
 
     // Reset cell ID
-    clContext.runKernel(KERNEL_TSDF_FILL_CELL_ID, {nbParticules});
+    clContext.setKernelArg(kernels.fillCellID, 0, inputPartPos);
+    clContext.runKernel(kernels.fillCellID, {nbParticles});
 
-    // Sort particules by cell ID
-    radixSort->sort("TSDF_cellID", {"TSDF_part_pos_tmp"});
+    // Sort particules by cell ID, only through indices: positions are only read once per cell afterwards
+    const CL::BufferHandle sortedIndices = radixSort->sortIndices(buffers.cellID, nbParticles);
 
     // Reset start and end ID of particules in a cell
-    clContext.runKernel(KERNEL_TSDF_RESET_START_END_CELL, {nbTSDFGridCells});
-    clContext.runKernel(KERNEL_TSDF_FILL_START_CELL, {nbParticules});
-    clContext.runKernel(KERNEL_TSDF_FILL_END_CELL, {nbParticules});
+    clContext.runKernel(kernels.resetStartEndCell, {nbTSDFGridCells});
+    clContext.runKernel(kernels.fillStartCell, {nbParticles});
+    clContext.runKernel(kernels.fillEndCell, {nbParticles});
 
-    clContext.runKernel(KERNEL_TSDF_ADJUST_END_CELL, {nbTSDFGridCells});
+    clContext.runKernel(kernels.adjustEndCell, {nbTSDFGridCells});
 
-    clContext.runKernel(KERNEL_TSDF_COMPUTE, {nbTSDFGridCells});
+    clContext.setKernelArg(kernels.computeGrid, 2, sortedIndices);
+    clContext.setKernelArg(kernels.computeGrid, 3, inputPartPos);
+    clContext.runKernel(kernels.computeGrid, {nbTSDFGridCells});
 }
 
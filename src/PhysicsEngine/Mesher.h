@@ -11,20 +11,27 @@
 namespace Physics {
     class Mesher {
     public:
-        Mesher(size_t TSDFGridRes, size_t nbPqrticules, size_t domainSize, size_t maxnbParticules, RadixSort* radixSort1);
+        // Only starts the program build, createKernels() must be called before use
+        Mesher(CL::Context &context, size_t TSDFGridRes, size_t domainSize, size_t maxnbParticules,
+               RadixSort* radixSort1);
+
+        // Waits for the program build
+        bool createKernels();
 
         void reset() const;
 
-        void updateMesher(const std::string& inputPartPos);
+        // Only the first nbParticles positions are binned, the current count of the simulation
+        void updateMesher(CL::BufferHandle inputPartPos, size_t nbParticles);
 
         ~Mesher() = default;
 
     private:
         bool createOpenCLProgram() const;
 
-        bool createBuffers() const;
+        bool createBuffers();
 
-        static bool createKernels();
+        // Context of the owning model
+        CL::Context &context;
 
         size_t simDomainSize;
 
@@ -33,9 +40,25 @@ namespace Physics {
         size_t maxNbParticules;
         size_t nbTSDFGridCells;
         size_t TSDFGridRes;
-        size_t nbParticules;
 
         //Sort system
         RadixSort* radixSort;
+
+        // OpenCL handles, resolved once at creation
+        struct {
+            CL::KernelHandle resetCellID;
+            CL::KernelHandle fillCellID;
+            CL::KernelHandle resetStartEndCell;
+            CL::KernelHandle fillStartCell;
+            CL::KernelHandle fillEndCell;
+            CL::KernelHandle adjustEndCell;
+            CL::KernelHandle computeGrid;
+        } kernels;
+
+        struct {
+            CL::BufferHandle grid;
+            CL::BufferHandle cellID;
+            CL::BufferHandle partStartEndID;
+        } buffers;
     };
 }
\ No newline at end of file
@@ -8,7 +8,10 @@
 #include "Logger.h"
 #include "Geometry.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
+#include <iterator>
 #include <iostream>
 #include <limits>
 #include <sstream>
@@ -17,6 +20,9 @@
 // Define program id
 #define PROGRAM_POSITION_BASED_FLUID "PositionBasedFluids"
 
+// Arena alias group of per-particle buffers living only inside one step
+#define TRANSIENT_PARTICLE_BUFFERS "p_transient"
+
 // utils.cl
 #define KERNEL_INFINITE_POS "infPosVerts"
 #define KERNEL_RESET_CAMERA_DIST "resetCameraDist"
@@ -66,6 +72,83 @@ namespace Physics {
         cl_float xsphViscosityCoeff = 0.0001f;
     };
 
+    namespace {
+        cl_float FluidKernelInputs::*GetParamMember(FluidParam param) {
+            switch (param) {
+                case FluidParam::RestDensity:
+                    return &FluidKernelInputs::restDensity;
+                case FluidParam::RelaxCFM:
+                    return &FluidKernelInputs::relaxCFM;
+                case FluidParam::TimeStep:
+                    return &FluidKernelInputs::timeStep;
+                case FluidParam::ArtPressureCoeff:
+                    return &FluidKernelInputs::artPressureCoeff;
+                case FluidParam::VorticityConfCoeff:
+                    return &FluidKernelInputs::vorticityConfCoeff;
+                case FluidParam::XsphViscosityCoeff:
+                    return &FluidKernelInputs::xsphViscosityCoeff;
+            }
+            return nullptr;
+        }
+
+        float EvaluateKeyframes(const std::map<float, float> &keyframes, float time) {
+            const auto next = keyframes.lower_bound(time);
+            if (next == keyframes.begin())
+                return next->second;
+            if (next == keyframes.end())
+                return std::prev(next)->second;
+
+            const auto prev = std::prev(next);
+            const float ratio = (time - prev->first) / (next->first - prev->first);
+            return prev->second + ratio * (next->second - prev->second);
+        }
+    }
+
+    struct FluidKernels {
+        CL::KernelHandle infinitePos;
+        CL::KernelHandle randomPos;
+        CL::KernelHandle resetPartDetector;
+        CL::KernelHandle fillPartDetector;
+        CL::KernelHandle resetCameraDist;
+        CL::KernelHandle fillCameraDist;
+        CL::KernelHandle fillColor;
+        CL::KernelHandle resetCellID;
+        CL::KernelHandle fillCellID;
+        CL::KernelHandle resetStartEndCell;
+        CL::KernelHandle fillStartCell;
+        CL::KernelHandle fillEndCell;
+        CL::KernelHandle adjustEndCell;
+        CL::KernelHandle predictPos;
+        CL::KernelHandle applyBoundary;
+        CL::KernelHandle density;
+        CL::KernelHandle constraintFactor;
+        CL::KernelHandle constraintCorrection;
+        CL::KernelHandle correctPos;
+        CL::KernelHandle updateVel;
+        CL::KernelHandle computeVorticity;
+        CL::KernelHandle vorticityConfinement;
+        CL::KernelHandle xsphViscosity;
+        CL::KernelHandle updatePos;
+    };
+
+    struct FluidBuffers {
+        CL::BufferHandle fluidParams;
+        CL::BufferHandle cameraPos;
+        CL::BufferHandle pos;
+        CL::BufferHandle col;
+        CL::BufferHandle partDetector;
+        CL::BufferHandle density;
+        CL::BufferHandle predPos;
+        CL::BufferHandle corrPos;
+        CL::BufferHandle constFactor;
+        CL::BufferHandle vel;
+        CL::BufferHandle velInViscosity;
+        CL::BufferHandle vort;
+        CL::BufferHandle cellID;
+        CL::BufferHandle cameraDist;
+        CL::BufferHandle startEndPartID;
+    };
+
     /*********************************************************************/
     /*********************************************************************/
     //                                                                   //
@@ -91,6 +174,32 @@ namespace Physics {
         kernelInputs->isVorticityConfEnabled = (cl_uint) enable;
         updatePramsInKernel();
     }
+
+    bool PositionBasedFluids::setRadixSortBackend(RadixSort::Backend backend) {
+        if (!init) return false;
+        return radixSort->setBackend(backend);
+    }
+
+    void PositionBasedFluids::benchmarkRadixSort(int numSorts) {
+        if (!init) return;
+
+        for (const size_t nbParticles: {currNbParticles, maxNbParticles}) {
+            const double multiPassMs = radixSort->benchmark(RadixSort::Backend::MULTI_PASS, nbParticles, numSorts);
+            LOG_INFO("Multi pass radix sort of {} keys : {} ms", nbParticles, multiPassMs);
+
+            if (radixSort->isOnesweepSupported()) {
+                const double onesweepMs = radixSort->benchmark(RadixSort::Backend::ONESWEEP, nbParticles, numSorts);
+                LOG_INFO("Onesweep radix sort of {} keys : {} ms", nbParticles, onesweepMs);
+            }
+        }
+    }
+
+    void PositionBasedFluids::addParamKeyframe(FluidParam param, float time, float value) {
+        if (!init) return;
+        paramKeyframes[param][time] = value;
+    }
+
+    void PositionBasedFluids::clearParamKeyframes() { paramKeyframes.clear(); }
     /*********************************************************************/
     /*********************************************************************/
     //                                                                   //
@@ -100,15 +209,21 @@ namespace Physics {
     /*********************************************************************/
 
     PositionBasedFluids::PositionBasedFluids(ModelParams params) : BasePhysicModel(params), simpleMode(true),
-                                                                   maxNbPartsInCell(100),
+                                                                   maxNbPartsInCell(PBF_NUM_MAX_PARTS_IN_CELL),
                                                                    nbJacobiIters(2),
                                                                    initalScene(Scenes::Drop),
                                                                    radixSort(std::make_unique<RadixSort>(
-                                                                           params.maxNbParticles)),
-                                                                   kernelInputs(std::make_unique<FluidKernelInputs>()) {
+                                                                           *context, params.maxNbParticles,
+                                                                           TRANSIENT_PARTICLE_BUFFERS)),
+                                                                   kernelInputs(std::make_unique<FluidKernelInputs>()),
+                                                                   paramsVersion(0),
+                                                                   simulatedTime(0.0f),
+                                                                   kernels(std::make_unique<FluidKernels>()),
+                                                                   buffers(std::make_unique<FluidBuffers>()),
+                                                                   isFrameReplayable(true) {
         if (useMesher) {
             // If it use mesher, need to init mesher system
-            mesher = std::make_unique<Mesher>(params.TSDFGridRes, params.currNbParticles, params.boxSize,
+            mesher = std::make_unique<Mesher>(*context, params.TSDFGridRes, params.boxSize,
                                               params.maxNbParticles, radixSort.get());
         }
 
@@ -118,9 +233,20 @@ namespace Physics {
         // Create associated buffers to send data to GPU
         createOpenCLBuffers();
 
+        // Sorted twice per frame, swaps with their twins cancel each other and frames stay replayable
+        radixSort->createDoubleBuffers({buffers->pos, buffers->col, buffers->vel, buffers->predPos});
+
+        // Every program is building by now, kernel creation only waits for the program it needs
+        radixSort->createKernels();
+        if (mesher) {
+            mesher->createKernels();
+        }
+
         // Create OpenCl Kernels inside our cl c file
         createOpenCLKernels();
 
+        frameCommands = context->createCommandList("PositionBasedFluidsFrame");
+
         init = (kernelInputs != nullptr);
 
         reset();
@@ -132,106 +258,122 @@ namespace Physics {
     bool PositionBasedFluids::createOpenCLProgram() const {
 
 
-        float effectRadius = ((float) boxSize) / gridRes;
-
+        // Integers only, float constants are derived from them in fluids.cl: the offline SPIR-V build gives the same options
         std::ostringstream openCLBuildOption;
-        openCLBuildOption << "-DEFFECT_RADIUS=" << Utils::FloatToStr(effectRadius);
-        openCLBuildOption << " -DABS_WALL_POS=" << Utils::FloatToStr(boxSize / 2.0f);
+        openCLBuildOption << "-DBOX_SIZE=" << boxSize;
         openCLBuildOption << " -DGRID_RES=" << gridRes;
-        openCLBuildOption << " -DGRID_CELL_SIZE=" << Utils::FloatToStr((float) boxSize / gridRes);
-        openCLBuildOption << " -DGRID_NUM_CELLS=" << nbCells;
         openCLBuildOption << " -DNUM_MAX_PARTS_IN_CELL=" << maxNbPartsInCell;
-        openCLBuildOption << " -DPOLY6_COEFF="
-                          << Utils::FloatToStr(315.0f / (64.0f * Math::PI_F * std::pow(effectRadius, 9.f)));
-        openCLBuildOption << " -DSPIKY_COEFF=" << Utils::FloatToStr(15.0f / (Math::PI_F * std::pow(effectRadius, 6.f)));
-        openCLBuildOption << " -DMAX_VEL=" << Utils::FloatToStr(30.0f);
 
         LOG_INFO(openCLBuildOption.str());
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
         clContext.createProgram(PROGRAM_POSITION_BASED_FLUID,
                                 std::vector<std::string>({"fluids.cl", "utils.cl", "grid.cl"}),
                                 openCLBuildOption.str());
         return true;
     }
 
-    bool PositionBasedFluids::createOpenCLBuffers() const {
+    bool PositionBasedFluids::createOpenCLBuffers() {
         LOG_INFO("Creating OpenCL Buffers");
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
+
+        // Read by every fluid kernel from constant memory, written at once when a param changes
+        buffers->fluidParams = clContext.createBuffer("u_fluidParams", sizeof(FluidKernelInputs), CL_MEM_READ_ONLY, "PBF");
 
-        // We are using openGL buffers to create OpenCL buffers <--> Same data on GPU
-        clContext.createGLBuffer("u_cameraPos", cameraVBO, CL_MEM_READ_ONLY);
-        clContext.createGLBuffer("p_pos", particlePosVBO, CL_MEM_READ_WRITE);
-        clContext.createGLBuffer("p_col", particleColVBO, CL_MEM_READ_WRITE);
+        if (!clContext.isGLInteropEnabled()) {
+            // No GL buffers to share, OpenCL owns all the data
+            buffers->cameraPos = clContext.createBuffer("u_cameraPos", 4 * sizeof(float), CL_MEM_READ_ONLY, "PBF");
+            buffers->pos = clContext.createBuffer("p_pos", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE, "PBF");
+            buffers->col = clContext.createBuffer("p_col", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE, "PBF");
+
+            buffers->partDetector = clContext.createBuffer("c_partDetector", 8 * nbCells * sizeof(float), CL_MEM_READ_WRITE, "PBF");
+
+            const std::array<float, 4> cameraPos = {0.0f, 0.0f, 0.0f, 0.0f};
+            clContext.loadBufferFromHost(buffers->cameraPos, 0, sizeof(cameraPos), cameraPos.data());
+        } else {
+            // We are using openGL buffers to create OpenCL buffers <--> Same data on GPU
+            buffers->cameraPos = clContext.createGLBuffer("u_cameraPos", cameraVBO, CL_MEM_READ_ONLY, "PBF");
+            buffers->pos = clContext.createGLBuffer("p_pos", particlePosVBO, CL_MEM_READ_WRITE, "PBF");
+            buffers->col = clContext.createGLBuffer("p_col", particleColVBO, CL_MEM_READ_WRITE, "PBF");
+
+            buffers->partDetector = clContext.createGLBuffer("c_partDetector", gridVBO, CL_MEM_READ_WRITE, "PBF");
+        }
 
-        clContext.createGLBuffer("c_partDetector", gridVBO, CL_MEM_READ_WRITE);
 
+        // All in one device allocation, carved by the context arena
+        buffers->predPos = clContext.createArenaBuffer("p_predPos", 4 * maxNbParticles * sizeof(float), "PBF");
+        buffers->constFactor = clContext.createArenaBuffer("p_constFactor", maxNbParticles * sizeof(float), "PBF");
+        buffers->vel = clContext.createArenaBuffer("p_vel", 4 * maxNbParticles * sizeof(float), "PBF");
+        buffers->cellID = clContext.createArenaBuffer("p_cellID", maxNbParticles * sizeof(unsigned int), "PBF");
+        buffers->cameraDist = clContext.createArenaBuffer("p_cameraDist", maxNbParticles * sizeof(unsigned int), "PBF");
 
-        clContext.createBuffer("p_density", maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_predPos", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_corrPos", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_constFactor", maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_vel", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_velInViscosity", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_vort", 4 * maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_cellID", maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
-        clContext.createBuffer("p_cameraDist", maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
+        // Only live between two kernels of a step, never at the same time: sharing one slot with the radix sort scratch.
+        // density: density -> constraintFactor, corrPos: constraintCorrection -> correctPos,
+        // vort: computeVorticity -> vorticityConfinement, velInViscosity: copy -> xsphViscosity
+        buffers->density = clContext.createArenaBuffer("p_density", maxNbParticles * sizeof(float), "PBF", TRANSIENT_PARTICLE_BUFFERS);
+        buffers->corrPos = clContext.createArenaBuffer("p_corrPos", 4 * maxNbParticles * sizeof(float), "PBF", TRANSIENT_PARTICLE_BUFFERS);
+        buffers->vort = clContext.createArenaBuffer("p_vort", 4 * maxNbParticles * sizeof(float), "PBF", TRANSIENT_PARTICLE_BUFFERS);
+        buffers->velInViscosity = clContext.createArenaBuffer("p_velInViscosity", 4 * maxNbParticles * sizeof(float), "PBF", TRANSIENT_PARTICLE_BUFFERS);
 
         // Hold start and end ID of particule in a cell of the grid, sorted by radix and use later for NN search
         // Also used in TSDF to create mesh
-        clContext.createBuffer("c_startEndPartID", 2 * nbCells * sizeof(unsigned int), CL_MEM_READ_WRITE);
+        buffers->startEndPartID = clContext.createArenaBuffer("c_startEndPartID", 2 * nbCells * sizeof(unsigned int), "PBF");
+
+        if (!clContext.allocateArena()) {
+            LOG_ERROR("Cannot allocate OpenCL buffers");
+            return false;
+        }
 
         LOG_INFO("OpenCL Buffers have been created properly");
         return true;
     }
 
     bool PositionBasedFluids::createOpenCLKernels() {
-
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
 
         // Init only
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_INFINITE_POS, {"p_pos"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RANDOM_POS, {"", "p_pos", "p_vel"});
+        kernels->infinitePos = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_INFINITE_POS, {"p_pos"});
+        kernels->randomPos = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RANDOM_POS, {"u_fluidParams", "p_pos", "p_vel"});
 
         // For rendering purpose only
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_PART_DETECTOR, {"c_partDetector"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_PART_DETECTOR, {"p_pos", "c_partDetector"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_CAMERA_DIST, {"p_cameraDist"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_CAMERA_DIST,
+        kernels->resetPartDetector = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_PART_DETECTOR, {"c_partDetector"});
+        kernels->fillPartDetector = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_PART_DETECTOR, {"p_pos", "c_partDetector"});
+        kernels->resetCameraDist = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_CAMERA_DIST, {"p_cameraDist"});
+        kernels->fillCameraDist = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_CAMERA_DIST,
                                {"p_pos", "u_cameraPos", "p_cameraDist"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_COLOR, {"p_vel", "", "p_col"});
+        kernels->fillColor = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_COLOR, {"p_vel", "u_fluidParams", "p_col"});
 
         // Radix Sort based on 3D grid, using predicted positions, not corrected ones
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_CELL_ID, {"p_cellID"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_CELL_ID, {"p_predPos", "p_cellID"});
+        kernels->resetCellID = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_CELL_ID, {"p_cellID"});
+        kernels->fillCellID = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_CELL_ID, {"p_predPos", "p_cellID"});
 
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_START_END_CELL, {"c_startEndPartID"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_START_CELL, {"p_cellID", "c_startEndPartID"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_END_CELL, {"p_cellID", "c_startEndPartID"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_ADJUST_END_CELL, {"c_startEndPartID"});
+        kernels->resetStartEndCell = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_RESET_START_END_CELL, {"c_startEndPartID"});
+        kernels->fillStartCell = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_START_CELL, {"p_cellID", "c_startEndPartID"});
+        kernels->fillEndCell = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_FILL_END_CELL, {"p_cellID", "c_startEndPartID"});
+        kernels->adjustEndCell = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_ADJUST_END_CELL, {"c_startEndPartID"});
 
         // Position Based Fluids
         /// Position prediction
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_PREDICT_POS, {"p_pos", "p_vel", "", "p_predPos"});
+        kernels->predictPos = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_PREDICT_POS, {"p_pos", "p_vel", "u_fluidParams", "p_predPos"});
         /// Boundary conditions
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_APPLY_BOUNDARY, {"p_predPos"});
+        kernels->applyBoundary = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_APPLY_BOUNDARY, {"p_predPos"});
         /// Jacobi solver to correct position
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_DENSITY,
-                               {"p_predPos", "c_startEndPartID", "", "p_density"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CONSTRAINT_FACTOR,
-                               {"p_predPos", "p_density", "c_startEndPartID", "", "p_constFactor"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CONSTRAINT_CORRECTION,
-                               {"p_constFactor", "c_startEndPartID", "p_predPos", "", "p_corrPos"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CORRECT_POS, {"p_corrPos", "p_predPos"});
+        kernels->density = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_DENSITY,
+                               {"p_predPos", "c_startEndPartID", "u_fluidParams", "p_density"});
+        kernels->constraintFactor = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CONSTRAINT_FACTOR,
+                               {"p_predPos", "p_density", "c_startEndPartID", "u_fluidParams", "p_constFactor"});
+        kernels->constraintCorrection = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CONSTRAINT_CORRECTION,
+                               {"p_constFactor", "c_startEndPartID", "p_predPos", "u_fluidParams", "p_corrPos"});
+        kernels->correctPos = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_CORRECT_POS, {"p_corrPos", "p_predPos"});
         /// Velocity update and correction using vorticity confinement and xsph viscosity
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_UPDATE_VEL, {"p_predPos", "p_pos", "", "p_vel"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_COMPUTE_VORTICITY,
-                               {"p_predPos", "c_startEndPartID", "p_vel", "", "p_vort"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_VORTICITY_CONFINEMENT,
-                               {"p_predPos", "c_startEndPartID", "p_vort", "", "p_vel"});
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_XSPH_VISCOSITY,
-                               {"p_predPos", "c_startEndPartID", "p_velInViscosity", "", "p_vel"});
+        kernels->updateVel = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_UPDATE_VEL, {"p_predPos", "p_pos", "u_fluidParams", "p_vel"});
+        kernels->computeVorticity = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_COMPUTE_VORTICITY,
+                               {"p_predPos", "c_startEndPartID", "p_vel", "u_fluidParams", "p_vort"});
+        kernels->vorticityConfinement = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_VORTICITY_CONFINEMENT,
+                               {"p_predPos", "c_startEndPartID", "p_vort", "u_fluidParams", "p_vel"});
+        kernels->xsphViscosity = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_XSPH_VISCOSITY,
+                               {"p_predPos", "c_startEndPartID", "p_velInViscosity", "u_fluidParams", "p_vel"});
         /// Position update
-        clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_UPDATE_POS, {"p_predPos", "p_pos"});
+        kernels->updatePos = clContext.createKernel(PROGRAM_POSITION_BASED_FLUID, KERNEL_UPDATE_POS, {"p_predPos", "p_pos"});
 
         LOG_INFO("Properly initiated OpenCl kernels");
         return true;
@@ -243,19 +385,23 @@ namespace Physics {
             return;
         }
 
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
 
+        simulatedTime = 0.0f;
+        evaluateParamKeyframes();
         updatePramsInKernel();
 
         initSceneParticules();
+        // Particles past the live range are only written here, their twins must hold the same values
+        radixSort->syncDoubleBuffers();
 
-        clContext.acquireGLBuffers({"p_pos", "c_partDetector"});
-        clContext.runKernel(KERNEL_RESET_PART_DETECTOR, nbCells);
-        clContext.runKernel(KERNEL_FILL_PART_DETECTOR, currNbParticles);
-        clContext.releaseGLBuffers({"p_pos", "c_partDetector"});
+        clContext.acquireGLBuffers({buffers->pos, buffers->partDetector});
+        clContext.runKernel(kernels->resetPartDetector, nbCells);
+        clContext.runKernel(kernels->fillPartDetector, currNbParticles);
+        clContext.releaseGLBuffers({buffers->pos, buffers->partDetector});
 
-        clContext.runKernel(KERNEL_RESET_CELL_ID, maxNbParticles);
-        clContext.runKernel(KERNEL_RESET_CAMERA_DIST, maxNbParticles);
+        clContext.runKernel(kernels->resetCellID, maxNbParticles);
+        clContext.runKernel(kernels->resetCameraDist, maxNbParticles);
         mesher->reset();
 
     }
@@ -267,32 +413,41 @@ namespace Physics {
         }
 
         // Get OpenCL context
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
 
         kernelInputs->dim = 3;
 
         const float effectRadius = ((float) boxSize) / gridRes;
         kernelInputs->effectRadius = effectRadius;
 
-        // Set kernels args
-        clContext.setKernelArg(KERNEL_RANDOM_POS, 0, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_PREDICT_POS, 2, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_UPDATE_VEL, 2, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_DENSITY, 2, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_CONSTRAINT_FACTOR, 3, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_CONSTRAINT_CORRECTION, 3, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_FILL_COLOR, 1, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_COMPUTE_VORTICITY, 3, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT, 3, sizeof(FluidKernelInputs), kernelInputs.get());
-        clContext.setKernelArg(KERNEL_XSPH_VISCOSITY, 3, sizeof(FluidKernelInputs), kernelInputs.get());
+        if (uploadedInputs && std::memcmp(uploadedInputs.get(), kernelInputs.get(), sizeof(FluidKernelInputs)) == 0)
+            return;
+
+        // Kernels keep u_fluidParams bound, a single write updates all of them and the recorded frame stays valid
+        if (!clContext.loadBufferFromHost(buffers->fluidParams, 0, sizeof(FluidKernelInputs), kernelInputs.get())) {
+            LOG_ERROR("Cannot upload fluid params");
+            return;
+        }
+
+        if (!uploadedInputs)
+            uploadedInputs = std::make_unique<FluidKernelInputs>();
+        *uploadedInputs = *kernelInputs;
+        ++paramsVersion;
+    }
+
+    void PositionBasedFluids::evaluateParamKeyframes() {
+        for (const auto &[param, keyframes]: paramKeyframes) {
+            if (!keyframes.empty())
+                kernelInputs.get()->*GetParamMember(param) = EvaluateKeyframes(keyframes, simulatedTime);
+        }
     }
 
     // Initialize the Scnene : this is where the magic happend !
     void PositionBasedFluids::initSceneParticules() {
 
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
 
-        clContext.acquireGLBuffers({"p_pos", "p_col"});
+        clContext.acquireGLBuffers({buffers->pos, buffers->col});
 
         std::vector<Math::float3> gridVerts;
 
@@ -357,22 +512,33 @@ namespace Physics {
         }
 
 
-        float inf = std::numeric_limits<float>::infinity();
-        std::vector<std::array<float, 4>> pos(maxNbParticles, std::array<float, 4>({inf, inf, inf, 0.0f}));
+        // Written in place through mapped views, no copy at all on host unified memory devices
+        const size_t particlesSize = 4 * sizeof(float) * maxNbParticles;
 
-        std::ranges::transform(gridVerts, pos.begin(), [](const Math::float3 &vertPos) -> std::array<float, 4> {
-            return {vertPos.x, vertPos.y, vertPos.z, 0.0f};
-        });
+        auto *pos = static_cast<std::array<float, 4> *>(clContext.mapBuffer(buffers->pos, 0, particlesSize, CL::argAccess::WRITE));
+        if (pos) {
+            const float inf = std::numeric_limits<float>::infinity();
+            std::fill(pos, pos + maxNbParticles, std::array<float, 4>({inf, inf, inf, 0.0f}));
 
-        clContext.loadBufferFromHost("p_pos", 0, 4 * sizeof(float) * pos.size(), pos.data());
+            std::ranges::transform(gridVerts, pos, [](const Math::float3 &vertPos) -> std::array<float, 4> {
+                return {vertPos.x, vertPos.y, vertPos.z, 0.0f};
+            });
+            clContext.unmapBuffer(buffers->pos);
+        }
 
-        std::vector<std::array<float, 4>> vel(maxNbParticles, std::array<float, 4>({0.0f, 0.0f, 0.0f, 0.0f}));
-        clContext.loadBufferFromHost("p_vel", 0, 4 * sizeof(float) * vel.size(), vel.data());
+        auto *vel = static_cast<std::array<float, 4> *>(clContext.mapBuffer(buffers->vel, 0, particlesSize, CL::argAccess::WRITE));
+        if (vel) {
+            std::fill(vel, vel + maxNbParticles, std::array<float, 4>({0.0f, 0.0f, 0.0f, 0.0f}));
+            clContext.unmapBuffer(buffers->vel);
+        }
 
-        std::vector<std::array<float, 4>> col(maxNbParticles, std::array<float, 4>({0.0f, 0.1f, 1.0f, 0.0f}));
-        clContext.loadBufferFromHost("p_col", 0, 4 * sizeof(float) * col.size(), col.data());
+        auto *col = static_cast<std::array<float, 4> *>(clContext.mapBuffer(buffers->col, 0, particlesSize, CL::argAccess::WRITE));
+        if (col) {
+            std::fill(col, col + maxNbParticles, std::array<float, 4>({0.0f, 0.1f, 1.0f, 0.0f}));
+            clContext.unmapBuffer(buffers->col);
+        }
 
-        clContext.releaseGLBuffers({"p_pos", "p_col"});
+        clContext.releaseGLBuffers({buffers->pos, buffers->col});
     }
 
     /*********************************************************************/
@@ -390,74 +556,135 @@ namespace Physics {
             return;
         }
 
-        CL::Context &clContext = CL::Context::Get();
+        CL::Context &clContext = *context;
+
+        if (!headless && !clContext.isGLInteropEnabled()) {
+            const std::array<float, 4> cameraCoord = {cameraPos.x, cameraPos.y, cameraPos.z, 0.0f};
+            clContext.loadBufferFromHost(buffers->cameraPos, 0, sizeof(cameraCoord), cameraCoord.data());
+        }
+
+        if (!paramKeyframes.empty()) {
+            evaluateParamKeyframes();
+            updatePramsInKernel();
+        }
+
+        const FrameSignature frameSignature = {currNbParticles, nbJacobiIters, pause, simpleMode,
+                                               (bool) kernelInputs->isVorticityConfEnabled, radixSort->getBackend()};
+        if (frameSignature != recordedFrameSignature) {
+            clContext.invalidateCommandList(frameCommands);
+            recordedFrameSignature = frameSignature;
+            // A paused frame only sorts once, leaving double buffers swapped: other frames can still be replayed
+            isFrameReplayable = true;
+        }
+
+        if (clContext.isRecorded(frameCommands)) {
+            clContext.replayCommandList(frameCommands);
+        } else if (isFrameReplayable) {
+            // Recorded frame is executed as well
+            clContext.beginRecording(frameCommands);
+            enqueueFrame();
+            isFrameReplayable = clContext.endRecording();
+        } else {
+            enqueueFrame();
+        }
 
-        clContext.acquireGLBuffers({"p_pos", "p_col", "c_partDetector", "u_cameraPos"});
+        if (!headless && !clContext.isGLInteropEnabled()) {
+            // Picked up by the renderer after the next update, copies overlap with it
+            clContext.startReadback(buffers->pos, 4 * currNbParticles * sizeof(float));
+            clContext.startReadback(buffers->col, 4 * currNbParticles * sizeof(float));
+            clContext.startReadback(buffers->partDetector, 8 * nbCells * sizeof(float));
+        }
+
+        if (!pause)
+            simulatedTime += kernelInputs->timeStep;
+
+        clContext.endProfilingFrame();
+    }
+
+    bool PositionBasedFluids::getRenderData(RenderData &data) {
+        if (!init)
+            return false;
+
+        CL::Context &clContext = *context;
+
+        size_t posSize = 0;
+        size_t colSize = 0;
+        data.pos = clContext.getReadback(buffers->pos, posSize);
+        data.col = clContext.getReadback(buffers->col, colSize);
+        data.gridDetector = clContext.getReadback(buffers->partDetector, data.gridDetectorSize);
+        data.nbParticles = std::min(posSize, colSize) / (4 * sizeof(float));
+
+        return data.pos != nullptr && data.col != nullptr && data.gridDetector != nullptr;
+    }
+
+    void PositionBasedFluids::enqueueFrame() {
+        CL::Context &clContext = *context;
+
+        clContext.acquireGLBuffers({buffers->pos, buffers->col, buffers->partDetector, buffers->cameraPos});
         if (!pause) {
             // Predict velocity and position
-            clContext.runKernel(KERNEL_PREDICT_POS, currNbParticles);
+            clContext.runKernel(kernels->predictPos, currNbParticles);
 
             // Spacial partitioning, it will create a tab with pCellID[ID] = id of the cell the ID particule is in
-            clContext.runKernel(KERNEL_FILL_CELL_ID, currNbParticles);
+            clContext.runKernel(kernels->fillCellID, currNbParticles);
 
             // Will sort the particules by cellID
-            radixSort->sort("p_cellID", {"p_pos", "p_col", "p_vel", "p_predPos"});
+            radixSort->sort(buffers->cellID, {buffers->pos, buffers->col, buffers->vel, buffers->predPos}, currNbParticles);
 
             // Will create an array with for each cell the index of the first and last particule in the cell
-            clContext.runKernel(KERNEL_RESET_START_END_CELL, nbCells);
-            clContext.runKernel(KERNEL_FILL_START_CELL, currNbParticles);
-            clContext.runKernel(KERNEL_FILL_END_CELL, currNbParticles);
+            clContext.runKernel(kernels->resetStartEndCell, nbCells);
+            clContext.runKernel(kernels->fillStartCell, currNbParticles);
+            clContext.runKernel(kernels->fillEndCell, currNbParticles);
 
             if (simpleMode)
-                clContext.runKernel(KERNEL_ADJUST_END_CELL, nbCells);
+                clContext.runKernel(kernels->adjustEndCell, nbCells);
 
             // Correcting positions to fit constraints
             for (int iter = 0; iter < nbJacobiIters; ++iter) {
                 // Clamping to boundary
-                clContext.runKernel(KERNEL_APPLY_BOUNDARY, currNbParticles);
+                clContext.runKernel(kernels->applyBoundary, currNbParticles);
                 // Computing density using SPH method
-                clContext.runKernel(KERNEL_DENSITY, currNbParticles);
+                clContext.runKernel(kernels->density, currNbParticles);
                 // Computing constraint factor Lambda
-                clContext.runKernel(KERNEL_CONSTRAINT_FACTOR, currNbParticles);
+                clContext.runKernel(kernels->constraintFactor, currNbParticles);
                 // Computing position correction
-                clContext.runKernel(KERNEL_CONSTRAINT_CORRECTION, currNbParticles);
+                clContext.runKernel(kernels->constraintCorrection, currNbParticles);
                 // Correcting predicted position
-                clContext.runKernel(KERNEL_CORRECT_POS, currNbParticles);
+                clContext.runKernel(kernels->correctPos, currNbParticles);
             }
 
             // Updating velocity
-            clContext.runKernel(KERNEL_UPDATE_VEL, currNbParticles);
+            clContext.runKernel(kernels->updateVel, currNbParticles);
 
             if (kernelInputs->isVorticityConfEnabled) {
                 // Computing vorticity
-                clContext.runKernel(KERNEL_COMPUTE_VORTICITY, currNbParticles);
+                clContext.runKernel(kernels->computeVorticity, currNbParticles);
                 // Applying vorticity confinement to attenue virtual damping
-                clContext.runKernel(KERNEL_VORTICITY_CONFINEMENT, currNbParticles);
+                clContext.runKernel(kernels->vorticityConfinement, currNbParticles);
                 // Copying velocity buffer as input for vorticity confinement correction
-                clContext.copyBuffer("p_vel", "p_velInViscosity");
+                clContext.copyBuffer(buffers->vel, buffers->velInViscosity);
                 // Applying xsph viscosity correction for a more coherent motion
-                clContext.runKernel(KERNEL_XSPH_VISCOSITY, currNbParticles);
+                clContext.runKernel(kernels->xsphViscosity, currNbParticles);
             }
 
             // Updating pos
-            clContext.runKernel(KERNEL_UPDATE_POS, currNbParticles);
+            clContext.runKernel(kernels->updatePos, currNbParticles);
 
             // Rendering purpose
-            clContext.runKernel(KERNEL_RESET_PART_DETECTOR, nbCells);
-            clContext.runKernel(KERNEL_FILL_PART_DETECTOR, currNbParticles);
-            clContext.runKernel(KERNEL_FILL_COLOR, currNbParticles);
+            clContext.runKernel(kernels->resetPartDetector, nbCells);
+            clContext.runKernel(kernels->fillPartDetector, currNbParticles);
+            clContext.runKernel(kernels->fillColor, currNbParticles);
         }
 
         // Meshing purpose
-        mesher->updateMesher("p_pos");
+        mesher->updateMesher(buffers->pos, currNbParticles);
 
         // Rendering purpose
-        clContext.runKernel(KERNEL_FILL_CAMERA_DIST, currNbParticles);
-
-        radixSort->sort("p_cameraDist", {"p_pos", "p_col", "p_vel", "p_predPos"});
+        clContext.runKernel(kernels->fillCameraDist, currNbParticles);
 
-        clContext.releaseGLBuffers({"p_pos", "p_col", "c_partDetector", "u_cameraPos"});
+        radixSort->sort(buffers->cameraDist, {buffers->pos, buffers->col, buffers->vel, buffers->predPos}, currNbParticles);
 
+        clContext.releaseGLBuffers({buffers->pos, buffers->col, buffers->partDetector, buffers->cameraPos});
     }
 
 }
\ No newline at end of file
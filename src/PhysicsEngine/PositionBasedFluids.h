@@ -9,6 +9,7 @@
 
 
 #include <array>
+#include <map>
 #include <vector>
 #include <memory>
 
@@ -16,6 +17,8 @@
 namespace Physics {
 
     struct FluidKernelInputs;
+    struct FluidKernels;
+    struct FluidBuffers;
 
     enum Scenes {
         Bath = 0,
@@ -35,6 +38,16 @@ namespace Physics {
             {Scenes::DoubleDrop,"Double drop"},
     };
 
+    // Fluid params which can be animated along the simulated time
+    enum class FluidParam {
+        RestDensity,
+        RelaxCFM,
+        TimeStep,
+        ArtPressureCoeff,
+        VorticityConfCoeff,
+        XsphViscosityCoeff,
+    };
+
     class PositionBasedFluids : public BasePhysicModel {
     public:
         PositionBasedFluids(ModelParams params);
@@ -45,6 +58,8 @@ namespace Physics {
 
         void reset() override;
 
+        bool getRenderData(RenderData &data) override;
+
         void setInitialScene(Scenes sceneI) { initalScene = sceneI; }
 
         const Scenes getInitialScene() const { return initalScene; }
@@ -62,19 +77,39 @@ namespace Physics {
         void enableVorticityConfinement(bool enable);
         [[nodiscard]] bool isVorticityConfinementEnabled() const;
 
+        bool setRadixSortBackend(RadixSort::Backend backend);
+        [[nodiscard]] RadixSort::Backend getRadixSortBackend() const { return radixSort->getBackend(); }
+        [[nodiscard]] bool isOnesweepSortSupported() const { return radixSort->isOnesweepSupported(); }
+        // Times both radix sort backends on the current and maximum number of particles, results are logged
+        void benchmarkRadixSort(int numSorts);
+
+        // Value is linearly interpolated between the keyframes of a param, held before the first and after the last one.
+        // Keyframes are evaluated every update, params are only uploaded to the device when they change.
+        void addParamKeyframe(FluidParam param, float time, float value);
+        void clearParamKeyframes();
+        // Sum of the time steps run since the last reset, in seconds
+        [[nodiscard]] float getSimulatedTime() const { return simulatedTime; }
+        // Incremented on every upload of the params
+        [[nodiscard]] size_t getParamsVersion() const { return paramsVersion; }
 
 
     private:
         bool createOpenCLProgram() const;
 
-        bool createOpenCLBuffers() const;
+        bool createOpenCLBuffers();
 
-        static bool createOpenCLKernels();
+        bool createOpenCLKernels();
 
         void updatePramsInKernel();
 
+        // Set the animated params to their value at the current simulated time
+        void evaluateParamKeyframes();
+
         void initSceneParticules();
 
+        // Enqueue all the work of a simulation frame
+        void enqueueFrame();
+
 
         bool simpleMode;
         size_t maxNbPartsInCell;
@@ -83,6 +118,32 @@ namespace Physics {
         // Utils
         std::unique_ptr<RadixSort> radixSort;
         std::unique_ptr<FluidKernelInputs> kernelInputs;
+        // Last params written to the device, null until the first upload
+        std::unique_ptr<FluidKernelInputs> uploadedInputs;
+        size_t paramsVersion;
+        // Time -> value, per animated param
+        std::map<FluidParam, std::map<float, float>> paramKeyframes;
+        float simulatedTime;
+        // OpenCL handles, resolved once at creation
+        std::unique_ptr<FluidKernels> kernels;
+        std::unique_ptr<FluidBuffers> buffers;
         std::unique_ptr<Mesher> mesher;
+
+        // Everything the recorded frame depends on, kernel params are read from their device buffer when it runs
+        struct FrameSignature {
+            size_t nbParticles = 0;
+            size_t nbJacobiIters = 0;
+            bool pause = false;
+            bool simpleMode = false;
+            bool isVorticityConfEnabled = false;
+            RadixSort::Backend sortBackend = RadixSort::Backend::MULTI_PASS;
+
+            bool operator==(const FrameSignature &other) const = default;
+        };
+
+        // Frame is recorded once and replayed as long as its signature does not change
+        CL::CommandListHandle frameCommands;
+        FrameSignature recordedFrameSignature;
+        bool isFrameReplayable;
     };
 }
\ No newline at end of file
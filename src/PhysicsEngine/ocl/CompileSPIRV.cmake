@@ -0,0 +1,37 @@
+# Compile a set of OpenCL C sources to a single SPIR-V module, run at build time with cmake -P
+# Sources are concatenated in order, same as a program created at runtime with several sources
+#
+# Expected variables : CLANG, LLVM_SPIRV, SOURCES (;-separated), OPTIONS (space-separated), OUTPUT
+
+get_filename_component(OUTPUT_NAME ${OUTPUT} NAME_WE)
+get_filename_component(OUTPUT_DIR ${OUTPUT} DIRECTORY)
+set(CONCAT_SOURCE ${OUTPUT_DIR}/${OUTPUT_NAME}.cl)
+set(BITCODE ${OUTPUT_DIR}/${OUTPUT_NAME}.bc)
+
+file(WRITE ${CONCAT_SOURCE} "")
+foreach(SOURCE ${SOURCES})
+  file(READ ${SOURCE} SOURCE_CODE)
+  file(APPEND ${CONCAT_SOURCE} "${SOURCE_CODE}\n")
+endforeach()
+
+separate_arguments(OPTIONS_LIST NATIVE_COMMAND "${OPTIONS}")
+
+# Same fast math options as the ones given at runtime by Context::createProgram
+execute_process(
+        COMMAND ${CLANG} -c -x cl -cl-std=CL1.2 -target spir64 -emit-llvm -O2
+        -cl-denorms-are-zero -cl-fast-relaxed-math ${OPTIONS_LIST}
+        -o ${BITCODE} ${CONCAT_SOURCE}
+        RESULT_VARIABLE CLANG_RESULT)
+if(NOT CLANG_RESULT EQUAL 0)
+  message(FATAL_ERROR "Cannot compile OpenCL program ${OUTPUT_NAME} to LLVM IR")
+endif()
+
+execute_process(
+        COMMAND ${LLVM_SPIRV} ${BITCODE} -o ${OUTPUT}
+        RESULT_VARIABLE SPIRV_RESULT)
+if(NOT SPIRV_RESULT EQUAL 0)
+  message(FATAL_ERROR "Cannot translate OpenCL program ${OUTPUT_NAME} to SPIR-V")
+endif()
+
+# Runtime only loads the module if it has been compiled with its exact compile-time constants
+file(WRITE ${OUTPUT_DIR}/${OUTPUT_NAME}.options "${OPTIONS}")
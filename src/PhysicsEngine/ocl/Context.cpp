@@ -29,41 +29,80 @@
 #include <OpenGL/OpenGL.h>
 #endif
 
+#include "EmbeddedSources.h"
 #include "ErrorCode.hpp"
 #include "Logger.h"
 #include "Utils.h"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
 #include <vector>
 #include <filesystem>
-
-Physics::CL::Context& Physics::CL::Context::Get()
-{
-  static Context context;
-  return context;
-}
-
-Physics::CL::Context::Context()
-    : m_isKernelProfilingEnabled(false)
+#include <future>
+
+Physics::CL::Context::Context(const contextSpecs& specs)
+    : m_programCache(specs.programCacheDir)
+    , m_tuningDatabase(specs.tuningDir)
+    , m_memoryBudget(0)
+    , m_allocatedMemory(0)
+    , m_peakAllocatedMemory(0)
+    , m_specs(specs)
+    , m_isILSupported(false)
+    , m_isOutOfOrder(false)
+    , m_isGLInteropEnabled(!specs.headless && specs.GLInterop)
+    , m_isHostUnifiedMemory(false)
+    , m_isGLEventSupported(false)
+    , m_isKernelProfilingEnabled(false)
     , m_init(false)
 {
   if (!findPlatforms())
     return;
 
-  if (!findGPUDevices())
-    return;
+  if (m_isGLInteropEnabled && (!findGPUDevices() || !createContext()))
+  {
+    // Buffers to render are read back to the host and uploaded to GL instead
+    LOG_INFO("No OpenCL context sharing buffers with OpenGL, falling back to host copies");
+    m_isGLInteropEnabled = false;
+    m_allCandidateDevices.clear();
+  }
 
-  if (!createContext())
+  if (!m_isGLInteropEnabled && (!findAllDevices() || !createContext()))
     return;
 
   if (!createCommandQueue())
     return;
 
+  const std::string extensions = cl_device.getInfo<CL_DEVICE_EXTENSIONS>();
+  m_isILSupported = (extensions.find("cl_khr_il_program") != std::string::npos);
+  LOG_INFO("SPIR-V programs {}supported by device", m_isILSupported ? "" : "not ");
+
+  m_isGLEventSupported = m_isGLInteropEnabled && (extensions.find("cl_khr_gl_event") != std::string::npos);
+  if (m_isGLInteropEnabled)
+    LOG_INFO("CL-GL event synchronization {}supported by device", m_isGLEventSupported ? "" : "not ");
+
+  // Deprecated in OpenCL 2.0, still the only way to know it on 1.2 devices
+  m_isHostUnifiedMemory = (cl_device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() == CL_TRUE);
+  LOG_INFO("Host unified memory {}supported by device", m_isHostUnifiedMemory ? "" : "not ");
+
+  m_tuningDatabase.open(cl_device);
+
+  const size_t deviceMemory = cl_device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+  m_memoryBudget = (m_specs.memoryBudget > 0) ? std::min(m_specs.memoryBudget, deviceMemory) : deviceMemory;
+  LOG_INFO("Device memory budget of {} MB", m_memoryBudget >> 20);
+
   m_init = true;
 }
 
+Physics::CL::Context::~Context()
+{
+  release();
+}
+
 bool Physics::CL::Context::findPlatforms()
 {
   LOG_INFO("Searching for OpenCL platforms");
@@ -129,12 +168,61 @@ bool Physics::CL::Context::findGPUDevices()
     }
 
     if (!GPUsOnPlatformWithInteropCLGL.empty())
-      m_allGPUsWithInteropCLGL.push_back(std::make_pair(platform, GPUsOnPlatformWithInteropCLGL));
+      m_allCandidateDevices.push_back(std::make_pair(platform, GPUsOnPlatformWithInteropCLGL));
+  }
+
+  if (m_allCandidateDevices.empty())
+  {
+    LOG_INFO("No GPU found with Interop OpenCL-OpenGL extension");
+    return false;
+  }
+
+  return true;
+}
+
+bool Physics::CL::Context::findAllDevices()
+{
+  LOG_INFO("Searching for any OpenCL device, without GL sharing");
+
+  // Prioritizing GPUs, then accelerators and finally CPUs
+  const std::vector<cl_device_type> typesByPriority = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ACCELERATOR, CL_DEVICE_TYPE_CPU };
+
+  for (const auto& platform : m_allPlatforms)
+  {
+    std::string platformName;
+    platform.getInfo(CL_PLATFORM_NAME, &platformName);
+
+    std::vector<cl::Device> devicesOnPlatform;
+
+    for (const auto& deviceType : typesByPriority)
+    {
+      std::vector<cl::Device> devicesOfType;
+      // Not finding any device of this type is not an error here
+      try
+      {
+        platform.getDevices(deviceType, &devicesOfType);
+      }
+      catch (const cl::Error&)
+      {
+        continue;
+      }
+
+      for (const auto& device : devicesOfType)
+      {
+        std::string deviceName;
+        device.getInfo(CL_DEVICE_NAME, &deviceName);
+        LOG_INFO("Found device {} on platform {}", deviceName, platformName);
+        devicesOnPlatform.push_back(device);
+      }
+    }
+
+    if (!devicesOnPlatform.empty())
+      m_allCandidateDevices.push_back(std::make_pair(platform, devicesOnPlatform));
   }
 
-  if (m_allGPUsWithInteropCLGL.empty())
+  if (m_allCandidateDevices.empty())
   {
-    LOG_ERROR("No GPU found with Interop OpenCL-OpenGL extension, cannot create an OpenCL context");
+    LOG_ERROR("No OpenCL device found, cannot create an OpenCL context");
     return false;
   }
 
@@ -149,11 +237,16 @@ bool Physics::CL::Context::createContext()
 
   LOG_INFO("Trying to create an OpenCL context");
 
-  for (const auto& platformGPU : m_allGPUsWithInteropCLGL)
+  for (const auto& platformGPU : m_allCandidateDevices)
   {
     const auto platform = platformGPU.first;
     const auto GPUs = platformGPU.second;
 
+    cl_context_properties headlessProps[] = {
+      CL_CONTEXT_PLATFORM, (cl_context_properties)platform(),
+      0
+    };
+
 #ifdef _WIN32
     cl_context_properties props[] = {
       CL_GL_CONTEXT_KHR, (cl_context_properties)wglGetCurrentContext(),
@@ -180,8 +273,22 @@ bool Physics::CL::Context::createContext()
 
     for (const auto& GPU : GPUs)
     {
-      cl_int err;
-      cl_context = cl::Context(GPU, props, nullptr, nullptr, &err);
+      // Contexts of other simulations may be asked to run on another device
+      if (!m_specs.deviceName.empty() && GPU.getInfo<CL_DEVICE_NAME>().find(m_specs.deviceName) == std::string::npos)
+        continue;
+
+      // Exceptions are enabled, a refused context throws instead of setting err
+      cl_int err = CL_SUCCESS;
+      try
+      {
+        cl_context = cl::Context(GPU, m_isGLInteropEnabled ? props : headlessProps, nullptr, nullptr, &err);
+      }
+      catch (const cl::Error& error)
+      {
+        LOG_INFO("Cannot create an OpenCL context on device {} : {}", GPU.getInfo<CL_DEVICE_NAME>(), ErrorCodeToStr(error.err()));
+        continue;
+      }
+
       if (err == CL_SUCCESS)
       {
         std::string platformName;
@@ -192,13 +299,16 @@ bool Physics::CL::Context::createContext()
         GPU.getInfo(CL_DEVICE_NAME, &deviceName);
         cl_device = GPU;
 
-        LOG_INFO("Success! Created an OpenCL context with platform {} and GPU {}", platformName, deviceName);
+        LOG_INFO("Success! Created an OpenCL context with platform {} and device {}", platformName, deviceName);
         return true;
       }
     }
   }
 
-  LOG_ERROR("Error while creating OpenCL context");
+  if (m_isGLInteropEnabled)
+    LOG_INFO("Cannot create an OpenCL context sharing the GL context");
+  else
+    LOG_ERROR("Error while creating OpenCL context");
   return false;
 }
 
@@ -209,6 +319,17 @@ bool Physics::CL::Context::createCommandQueue()
 
   cl_command_queue_properties properties = CL_QUEUE_PROFILING_ENABLE;
 
+  if (m_specs.outOfOrderQueue)
+  {
+    const auto supportedProperties = cl_device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>();
+    m_isOutOfOrder = (supportedProperties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+
+    if (m_isOutOfOrder)
+      properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    else
+      LOG_INFO("Out-of-order queue not supported by device, using in-order queue");
+  }
+
   cl_int err;
   cl_queue = cl::CommandQueue(cl_context, cl_device, properties, &err);
   if (err != CL_SUCCESS)
@@ -216,29 +337,103 @@ bool Physics::CL::Context::createCommandQueue()
     LOG_ERROR("Cannot create OpenCL queue");
     return false;
   }
+
+  cl_transferQueue = cl_queue;
+
+  if (m_specs.separateTransferQueue)
+  {
+    // Transfers are ordered among themselves, dependencies with simulation commands are explicit
+    cl::CommandQueue transferQueue(cl_context, cl_device, 0, &err);
+    if (err == CL_SUCCESS)
+      cl_transferQueue = transferQueue;
+    else
+      CL_ERROR(err, "Cannot create OpenCL transfer queue, transfers are done on the simulation queue");
+  }
+
   return true;
 }
 
 bool Physics::CL::Context::release()
 {
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
   if (!m_init)
     return true;
 
+  // Pinned memory stays mapped until now
+  for (auto& [bufferId, readback] : m_readbacks)
+  {
+    for (auto& slot : readback.slots)
+    {
+      if (slot.hostPtr != nullptr)
+        cl_transferQueue.enqueueUnmapMemObject(slot.pinned, slot.hostPtr, nullptr, nullptr);
+    }
+  }
+
   finishTasks();
 
   LOG_DEBUG("Physics::CL::Context::release - Context has been cleaned");
 
+  // Builds still running reference their program entry
+  for (auto& [programName, programObj] : m_programsMap)
+  {
+    if (programObj.build.valid())
+      programObj.build.wait();
+  }
+
+  m_profiler.reset();
+  m_dependencies.clear();
+  m_pendingTransfers.clear();
+  m_GLFenceEvent = cl::Event();
+  m_commandLists.clear();
+  m_recordingList = {};
   m_programsMap.clear();
-  m_kernelsMap.clear();
-  m_buffersMap.clear();
-  m_GLBuffersMap.clear();
-  m_imagesMap.clear();
+  m_kernels.clear();
+  m_bufferArgs.clear();
+  m_memoryObjects.clear();
+  m_arenaSlots.clear();
+  m_arena = cl::Buffer();
+  m_readbacks.clear();
+  m_allocatedMemory = 0;
+  m_kernelIds.clear();
+  m_memoryObjectIds.clear();
 
   return true;
 }
 
+void Physics::CL::Context::enableProfiler(bool enable)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  // Starting again from an empty window, old timings are not relevant anymore
+  if (enable != m_isKernelProfilingEnabled)
+    m_profiler.reset();
+
+  m_isKernelProfilingEnabled = enable;
+}
+
+void Physics::CL::Context::endProfilingFrame()
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  m_lastFrameArgStats = m_frameArgStats;
+  m_frameArgStats = {};
+
+  if (!m_isKernelProfilingEnabled)
+    return;
+
+  // Make sure the frame events are submitted, otherwise they may never complete
+  cl_int err = cl_queue.flush();
+  if (err != CL_SUCCESS)
+    CL_ERROR(err, "Cannot flush queue");
+
+  m_profiler.endFrame();
+}
+
 bool Physics::CL::Context::finishTasks()
 {
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
   cl_int err = cl_queue.flush();
   if (err != CL_SUCCESS)
   {
@@ -253,541 +448,2073 @@ bool Physics::CL::Context::finishTasks()
     return false;
   }
 
-  LOG_DEBUG("Explicitly flushed and finished OpenCL device queue");
-  return true;
-}
-
-bool Physics::CL::Context::createProgram(std::string programName, std::vector<std::string> sourceNames, std::string specificBuildOptions)
-{
-  if (!m_init)
-    return false;
-
-  cl::Program::Sources sources;
-  for (const auto& sourceName : sourceNames)
+  if (isTransferQueue(cl_transferQueue))
   {
-    // Little hack to make it work from both installer and local build
-    std::ifstream sourceFile(std::filesystem::path("./kernels/" + sourceName).string());
-
-    if (!sourceFile.is_open())
-      sourceFile.open(std::filesystem::path(Utils::GetSrcDir() + "/physics/ocl/kernels/" + sourceName).string());
-
-    if (!sourceFile.is_open())
-      LOG_ERROR("Cannot find kernel file {}", sourceName);
-
-    std::string sourceCode(std::istreambuf_iterator<char>(sourceFile), (std::istreambuf_iterator<char>()));
-    sources.push_back(sourceCode);
+    err = cl_transferQueue.finish();
+    if (err != CL_SUCCESS)
+    {
+      CL_ERROR(err, "Cannot finish transfer queue");
+      return false;
+    }
   }
 
-  auto program = cl::Program(cl_context, sources);
-
-  std::string options = specificBuildOptions + std::string(" -cl-denorms-are-zero -cl-fast-relaxed-math");
-  cl_int err = program.build({ cl_device }, options.c_str());
-  if (err != CL_SUCCESS) 
-  {
-    CL_ERROR(err, "Cannot build program");
-    LOG_ERROR(program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cl_device));
-    throw std::runtime_error(" Exiting Program ");
-    return false;
-  }
+  // Queues are idle, nothing left to wait for
+  m_dependencies.clear();
+  m_pendingTransfers.clear();
 
-  m_programsMap.insert(std::make_pair(programName, program));
+  // Queue is idle, pending profiling events can be resolved for free
+  if (m_isKernelProfilingEnabled)
+    m_profiler.flush();
 
+  LOG_DEBUG("Explicitly flushed and finished OpenCL device queue");
   return true;
 }
 
-bool Physics::CL::Context::createBuffer(std::string bufferName, size_t bufferSize, cl_mem_flags memoryFlags)
+std::shared_future<bool> Physics::CL::Context::createProgram(std::string programName, std::vector<std::string> sourceNames, std::string specificBuildOptions)
 {
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
   if (!m_init)
-    return false;
+    return {};
 
-  cl_int err;
+  const auto it = m_programsMap.find(programName);
+  if (it != m_programsMap.end())
+    return it->second.build;
 
-  if (m_buffersMap.find(bufferName) != m_buffersMap.end())
+  // Map nodes are never moved, the worker only fills the program of its own entry
+  programObject& programObj = m_programsMap[programName];
+  programObj.build = std::async(std::launch::async, [this, &programObj, programName, sourceNames, specificBuildOptions]()
+                                { return buildProgram(programName, sourceNames, specificBuildOptions, programObj.program); })
+                         .share();
+
+  return programObj.build;
+}
+
+bool Physics::CL::Context::waitForProgram(const std::string& programName, cl::Program& program)
+{
+  const auto it = m_programsMap.find(programName);
+  if (it == m_programsMap.end() || !it->second.build.valid())
   {
-    LOG_ERROR("Buffer {} already existing", bufferName);
+    LOG_ERROR("OpenCL program not existing {}", programName);
     return false;
   }
 
-  auto buffer = cl::Buffer(cl_context, memoryFlags, bufferSize, nullptr, &err);
-
-  if (err != CL_SUCCESS)
+  // Build errors are logged by the worker, it resolves to false
+  bool isBuilt = false;
+  try
   {
-    LOG_ERROR("Cannot create buffer {}", bufferName);
-    return false;
+    isBuilt = it->second.build.get();
+  }
+  catch (const std::exception& error)
+  {
+    LOG_ERROR("Cannot build program {} : {}", programName, error.what());
   }
 
-  m_buffersMap.insert(std::make_pair(bufferName, buffer));
+  if (!isBuilt)
+    return false;
 
+  program = it->second.program;
   return true;
 }
 
-bool Physics::CL::Context::createImage2D(std::string name, imageSpecs specs, cl_mem_flags memoryFlags)
+bool Physics::CL::Context::buildProgram(const std::string& programName, const std::vector<std::string>& sourceNames, const std::string& specificBuildOptions, cl::Program& program) const
 {
-  if (!m_init)
-    return false;
-
-  cl_int err;
+  // Offline compiled module first, no front-end parsing at all
+  std::vector<char> IL;
+  if (m_isILSupported && findProgramIL(programName, specificBuildOptions, IL) && buildProgramFromIL(programName, IL, program))
+    return true;
 
-  if (m_imagesMap.find(name) != m_imagesMap.end())
+  cl::Program::Sources sources;
+  for (const auto& sourceName : sourceNames)
   {
-    LOG_ERROR("Image {} already existing", name);
-    return false;
-  }
+    // Embedded in the executable, no file to find next to it
+    std::string sourceCode = Utils::LoadSource(sourceName);
 
-  cl::ImageFormat format(specs.channelOrder, specs.channelType);
-
-  auto image = cl::Image2D(cl_context, memoryFlags, format, specs.width, specs.height, 0, nullptr, &err);
+    if (sourceCode.empty())
+      LOG_ERROR("Cannot find kernel source {}", sourceName);
 
-  if (err != CL_SUCCESS)
-  {
-    LOG_ERROR("Cannot create image {}", name);
-    return false;
+    sources.push_back(sourceCode);
   }
 
-  m_imagesMap.insert(std::make_pair(name, image));
-
-  return true;
-}
-
-bool Physics::CL::Context::loadBufferFromHost(std::string bufferName, size_t offset, size_t sizeToFill, const void* hostPtr)
-{
-  if (!m_init)
-    return false;
+  std::string options = specificBuildOptions + std::string(" -cl-denorms-are-zero -cl-fast-relaxed-math");
 
-  cl_int err;
+  // Const qualifiers of kernel args tell which buffers are only read
+  if (m_isOutOfOrder)
+    options += " -cl-kernel-arg-info";
 
-  cl::Buffer destBuffer;
+  // Skip the whole front-end and compilation if this exact program has already been built on this device
+  const std::string cacheKey = m_programCache.computeKey(cl_device, sources, options);
 
-  auto itSrc = m_buffersMap.find(bufferName);
-  if (itSrc == m_buffersMap.end())
+  if (!m_programCache.load(cacheKey, cl_context, cl_device, options, program))
   {
-    auto itSrcGL = m_GLBuffersMap.find(bufferName);
-
-    if (itSrcGL == m_GLBuffersMap.end())
+    // Exceptions are enabled, a failed build throws instead of returning its error
+    try
     {
-      LOG_ERROR("Buffer {} not existing", bufferName);
-      return false;
+      program = cl::Program(cl_context, sources);
+      program.build({ cl_device }, options.c_str());
     }
-    else
+    catch (const cl::Error& error)
     {
-      destBuffer = itSrcGL->second;
+      CL_ERROR(error.err(), "Cannot build program " + programName);
+      if (program() != nullptr)
+        LOG_ERROR(program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cl_device));
+      return false;
     }
-  }
-  else
-    destBuffer = itSrc->second;
-
-  err = cl_queue.enqueueWriteBuffer(destBuffer, CL_TRUE, offset, sizeToFill, hostPtr);
 
-  if (err != CL_SUCCESS)
-  {
-    LOG_ERROR("Cannot load buffer {}", bufferName);
-    return false;
+    m_programCache.store(cacheKey, program);
   }
 
+  LOG_INFO("Built program {}", programName);
   return true;
 }
 
-bool Physics::CL::Context::unloadBufferFromDevice(std::string bufferName, size_t offset, size_t sizeToFill, void* hostPtr)
+bool Physics::CL::Context::findProgramIL(const std::string& programName, const std::string& specificBuildOptions, std::vector<char>& IL) const
 {
-  if (!m_init)
-    return false;
-
-  cl_int err;
-
-  cl::Buffer srcBuffer;
+  // Written next to the executable by the build, whatever directory it is launched from
+  const std::string modulePath = (std::filesystem::path(Utils::GetExecutableDir()) / "kernels" / "spirv" / programName).string();
 
-  auto itSrc = m_buffersMap.find(bufferName);
-  if (itSrc == m_buffersMap.end())
+  std::ifstream optionsFile(modulePath + ".options");
+  if (!optionsFile.is_open())
   {
-    auto itSrcGL = m_GLBuffersMap.find(bufferName);
-
-    if (itSrcGL == m_GLBuffersMap.end())
-    {
-      LOG_ERROR("Buffer {} not existing", bufferName);
-      return false;
-    }
-    else
-    {
-      srcBuffer = itSrcGL->second;
-    }
+    LOG_INFO("No SPIR-V module of program {} at {}.spv, using sources", programName, modulePath);
+    return false;
   }
-  else
-    srcBuffer = itSrc->second;
 
-  err = cl_queue.enqueueReadBuffer(srcBuffer, CL_TRUE, offset, sizeToFill, hostPtr);
+  // Compile-time constants are baked in the module, compare them token by token to ignore spacing
+  const auto tokenize = [](std::istream& stream)
+  {
+    return std::vector<std::string>(std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>());
+  };
+  std::istringstream requestedOptions(specificBuildOptions);
+  if (tokenize(optionsFile) != tokenize(requestedOptions))
+  {
+    LOG_INFO("SPIR-V module of program {} built with other compile-time constants, using sources", programName);
+    return false;
+  }
 
-  if (err != CL_SUCCESS)
+  std::ifstream moduleFile(modulePath + ".spv", std::ios::binary);
+  if (!moduleFile.is_open())
   {
-    LOG_ERROR("Cannot unload buffer {}", bufferName);
+    LOG_INFO("No SPIR-V module of program {} at {}.spv, using sources", programName, modulePath);
     return false;
   }
 
-  return true;
+  IL.assign(std::istreambuf_iterator<char>(moduleFile), std::istreambuf_iterator<char>());
+  return !IL.empty();
 }
 
-bool Physics::CL::Context::swapBuffers(std::string bufferNameA, std::string bufferNameB)
+bool Physics::CL::Context::createProgramFromIL(const std::string& programName, const std::vector<char>& IL)
 {
-  if (!m_init)
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init || !m_isILSupported)
     return false;
 
-  const auto& itA = m_buffersMap.find(bufferNameA);
-  if (itA == m_buffersMap.end())
+  if (m_programsMap.find(programName) != m_programsMap.end())
   {
-    LOG_ERROR("Cannot swap buffers, buffer {} not existing", bufferNameA);
+    LOG_ERROR("OpenCL program already existing {}", programName);
     return false;
   }
 
-  const auto& itB = m_buffersMap.find(bufferNameB);
-  if (itB == m_buffersMap.end())
-  {
-    LOG_ERROR("Cannot swap buffers, buffer {} not existing", bufferNameB);
+  cl::Program program;
+  if (!buildProgramFromIL(programName, IL, program))
     return false;
-  }
 
-  auto tempBuffer = itA->second;
-  itA->second = itB->second;
-  itB->second = tempBuffer;
+  // Already built, exposed as a ready future like the asynchronous builds
+  std::promise<bool> build;
+  build.set_value(true);
+  m_programsMap[programName] = { build.get_future().share(), program };
 
   return true;
 }
 
-bool Physics::CL::Context::copyBuffer(std::string srcBufferName, std::string dstBufferName)
+bool Physics::CL::Context::buildProgramFromIL(const std::string& programName, const std::vector<char>& IL, cl::Program& program) const
 {
-  if (!m_init)
-    return false;
-
-  cl_int err;
-
-  cl::Buffer srcBuffer;
-
-  const auto& itSrc = m_buffersMap.find(srcBufferName);
-
-  if (itSrc == m_buffersMap.end())
-  {
-    auto itSrcGL = m_GLBuffersMap.find(srcBufferName);
-
-    if (itSrcGL == m_GLBuffersMap.end())
-    {
-      LOG_ERROR("Cannot copy buffers, source buffer {} not existing", srcBufferName);
-      return false;
-    }
-    else
-    {
-      srcBuffer = itSrcGL->second;
-    }
-  }
-  else
-  {
-    srcBuffer = itSrc->second;
-  }
+  // Program target is OpenCL 1.2, so the KHR extension entry point is used instead of the core 2.1 one.
+  // Looked up each time, contexts may live on different platforms
+  using createProgramWithILKHR = cl_program(CL_API_CALL*)(cl_context, const void*, size_t, cl_int*);
+  const auto clCreateProgramWithILKHR = reinterpret_cast<createProgramWithILKHR>(
+      clGetExtensionFunctionAddressForPlatform(cl_platform(), "clCreateProgramWithILKHR"));
 
-  const auto& itDst = m_buffersMap.find(dstBufferName);
-  if (itDst == m_buffersMap.end())
+  if (clCreateProgramWithILKHR == nullptr)
   {
-    LOG_ERROR("Cannot copy buffers, destination buffer {} not existing", dstBufferName);
+    LOG_ERROR("Cannot find clCreateProgramWithILKHR entry point");
     return false;
   }
 
-  cl::Buffer dstBuffer = itDst->second;
-  size_t dstBufferSize;
-  err = dstBuffer.getInfo(CL_MEM_SIZE, &dstBufferSize);
-
+  cl_int err;
+  cl_program programId = clCreateProgramWithILKHR(cl_context(), IL.data(), IL.size(), &err);
   if (err != CL_SUCCESS)
   {
-    CL_ERROR(err, "Cannot get size from buffer " + dstBufferName);
+    CL_ERROR(err, "Cannot create program " + programName + " from SPIR-V");
     return false;
   }
 
-  size_t srcBufferSize;
-  err = srcBuffer.getInfo(CL_MEM_SIZE, &srcBufferSize);
+  // Takes ownership of the program id
+  program = cl::Program(programId);
 
-  if (err != CL_SUCCESS)
-  {
-    CL_ERROR(err, "Cannot get size from buffer" + srcBufferName);
-    return false;
-  }
+  // Compile-time constants are already in the module, only the optimization options are needed
+  const std::string options = m_isOutOfOrder ? "-cl-denorms-are-zero -cl-fast-relaxed-math -cl-kernel-arg-info" : "-cl-denorms-are-zero -cl-fast-relaxed-math";
 
-  if (dstBufferSize > srcBufferSize)
+  try
   {
-    LOG_ERROR("Source buffer {} with size {} is smaller than destination buffer {} with size {} ", srcBufferName, srcBufferSize, dstBufferName, dstBufferSize);
-    return false;
+    program.build({ cl_device }, options.c_str());
   }
-
-  // Only copying the amount of data which can fit into the destination buffer
-  err = cl_queue.enqueueCopyBuffer(srcBuffer, dstBuffer, 0, 0, dstBufferSize);
-
-  if (err != CL_SUCCESS)
+  catch (const cl::Error& error)
   {
-    CL_ERROR(err, "Cannot copy buffer " + srcBufferName + " to buffer " + dstBufferName);
+    CL_ERROR(error.err(), "Cannot build program " + programName + " from SPIR-V");
+    LOG_ERROR(program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cl_device));
     return false;
   }
 
+  LOG_INFO("Built program {} from SPIR-V module", programName);
   return true;
 }
 
-bool Physics::CL::Context::createGLBuffer(std::string GLBufferName, unsigned int VBOIndex, cl_mem_flags memoryFlags)
+Physics::CL::BufferHandle Physics::CL::Context::registerMemoryObject(const std::string& name, memoryKind kind, const cl::Buffer& buffer, const cl::Image2D& image, size_t size, cl_mem_flags flags, const std::string& owner)
 {
-  if (!m_init)
-    return false;
+  const BufferHandle handle { static_cast<uint32_t>(m_memoryObjects.size()) };
 
-  cl_int err;
+  memoryObject memoryObj { name, kind, buffer, image };
+  memoryObj.owner = owner.empty() ? "Unknown" : owner;
+  memoryObj.size = size;
+  memoryObj.flags = flags;
 
-  if (m_GLBuffersMap.find(GLBufferName) != m_GLBuffersMap.end())
-  {
-    LOG_ERROR("GL buffer {} already existing", GLBufferName);
-    return false;
-  }
+  m_memoryObjects.push_back(std::move(memoryObj));
+  m_memoryObjectIds.insert(std::make_pair(name, handle.id));
 
+  return handle;
+}
 
-  auto GLBuffer = cl::BufferGL(cl_context, memoryFlags, (cl_GLuint)VBOIndex, &err);
+cl_mem_flags Physics::CL::Context::getAllocationFlags(cl_mem_flags memoryFlags) const
+{
+  const cl_mem_flags hostFlags = CL_MEM_ALLOC_HOST_PTR | CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR;
+  if (!m_isHostUnifiedMemory || (memoryFlags & hostFlags) != 0)
+    return memoryFlags;
 
-  if (err != CL_SUCCESS)
+  // Same memory for the device and the host, mapping the buffer then needs no copy
+  return memoryFlags | CL_MEM_ALLOC_HOST_PTR;
+}
+
+bool Physics::CL::Context::reserveMemory(const std::string& name, const std::string& owner, size_t size)
+{
+  if (m_allocatedMemory + size > m_memoryBudget)
   {
-    CL_ERROR(err, "Cannot create GL buffer " + GLBufferName);
+    LOG_ERROR("Cannot create {} ({}) of {} MB, {} MB already used out of a budget of {} MB", name, owner.empty() ? "Unknown" : owner,
+        size >> 20, m_allocatedMemory >> 20, m_memoryBudget >> 20);
     return false;
   }
 
-  m_GLBuffersMap.insert(std::make_pair(GLBufferName, GLBuffer));
+  m_allocatedMemory += size;
+  m_peakAllocatedMemory = std::max(m_peakAllocatedMemory, m_allocatedMemory);
 
   return true;
 }
 
-bool Physics::CL::Context::createKernel(std::string programName, std::string kernelName, std::vector<std::string> argNames)
+Physics::CL::memoryReport Physics::CL::Context::getMemoryReport() const
 {
-  // WIP Only taking buffer as args for now
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
-  if (!m_init)
-    return false;
+  memoryReport report;
+  report.totalBytes = m_allocatedMemory;
+  report.peakBytes = m_peakAllocatedMemory;
+  report.budgetBytes = m_memoryBudget;
+  if (m_init)
+    report.deviceBytes = cl_device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
 
-  cl_int err;
+  std::map<std::string, size_t> ownerBytes;
 
-  if (m_programsMap.find(programName) == m_programsMap.end())
+  // Aliased buffers share the memory of their slot, counted once for the first buffer of the slot
+  std::unordered_map<uint32_t, const arenaSlot*> aliasSlots;
+  for (const auto& slot : m_arenaSlots)
   {
-    LOG_ERROR("OpenCL program not existing {}", programName);
-    return false;
+    if (slot.memoryObjectIds.size() < 2)
+      continue;
+
+    for (const auto id : slot.memoryObjectIds)
+      aliasSlots[id] = &slot;
+
+    ownerBytes[m_memoryObjects[slot.memoryObjectIds.front()].owner] += slot.size;
   }
 
-  if (m_kernelsMap.find(kernelName) != m_kernelsMap.end())
+  for (uint32_t id = 0; id < m_memoryObjects.size(); ++id)
   {
-    LOG_ERROR("OpenCL kernel already existing {}", kernelName);
-    return false;
+    const auto& memoryObj = m_memoryObjects[id];
+
+    bufferMemory buffer;
+    buffer.name = memoryObj.name;
+    buffer.owner = memoryObj.owner;
+    buffer.kind = (memoryObj.kind == memoryKind::BUFFER) ? "Buffer" : (memoryObj.kind == memoryKind::BUFFER_GL) ? "GL buffer" : "Image 2D";
+    buffer.bytes = memoryObj.size;
+    buffer.flags = memoryObj.flags;
+
+    const auto slotIt = aliasSlots.find(id);
+    if (slotIt != aliasSlots.end())
+      buffer.aliasGroup = slotIt->second->aliasGroup;
+    else
+      ownerBytes[memoryObj.owner] += memoryObj.size;
+
+    report.buffers.push_back(std::move(buffer));
   }
 
-  auto kernel = cl::Kernel(m_programsMap.at(programName), kernelName.c_str(), &err);
+  report.owners.assign(ownerBytes.cbegin(), ownerBytes.cend());
+  std::sort(report.owners.begin(), report.owners.end(), [](const auto& a, const auto& b)
+      { return a.second > b.second; });
 
-  if (err != CL_SUCCESS)
-  {
+  return report;
+}
+
+Physics::CL::BufferHandle Physics::CL::Context::findBuffer(const std::string& name) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  const auto it = m_memoryObjectIds.find(name);
+  if (it == m_memoryObjectIds.end())
+  {
+    LOG_ERROR("Buffer {} not existing", name);
+    return {};
+  }
+
+  return { it->second };
+}
+
+size_t Physics::CL::Context::getBufferSize(BufferHandle buffer) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  return isValid(buffer) ? m_memoryObjects[buffer.id].size : 0;
+}
+
+bool Physics::CL::Context::isSwappable(BufferHandle buffer) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  return isValid(buffer) && m_memoryObjects[buffer.id].kind == memoryKind::BUFFER && !m_memoryObjects[buffer.id].isAliased;
+}
+
+std::vector<Physics::CL::BufferHandle> Physics::CL::Context::findBuffers(const std::vector<std::string>& names) const
+{
+  std::vector<BufferHandle> buffers;
+  buffers.reserve(names.size());
+
+  for (const auto& name : names)
+    buffers.push_back(findBuffer(name));
+
+  return buffers;
+}
+
+Physics::CL::KernelHandle Physics::CL::Context::findKernel(const std::string& name) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  const auto it = m_kernelIds.find(name);
+  if (it == m_kernelIds.end())
+  {
+    LOG_ERROR("OpenCL kernel {} not existing", name);
+    return {};
+  }
+
+  return { it->second };
+}
+
+Physics::CL::BufferHandle Physics::CL::Context::createBuffer(const std::string& bufferName, size_t bufferSize, cl_mem_flags memoryFlags, const std::string& owner)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  cl_int err;
+
+  if (m_memoryObjectIds.find(bufferName) != m_memoryObjectIds.end())
+  {
+    LOG_ERROR("Buffer {} already existing", bufferName);
+    return {};
+  }
+
+  if (!reserveMemory(bufferName, owner, bufferSize))
+    return {};
+
+  memoryFlags = getAllocationFlags(memoryFlags);
+  auto buffer = cl::Buffer(cl_context, memoryFlags, bufferSize, nullptr, &err);
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot create buffer {}", bufferName);
+    m_allocatedMemory -= bufferSize;
+    return {};
+  }
+
+  return registerMemoryObject(bufferName, memoryKind::BUFFER, buffer, cl::Image2D(), bufferSize, memoryFlags, owner);
+}
+
+Physics::CL::BufferHandle Physics::CL::Context::createArenaBuffer(const std::string& bufferName, size_t bufferSize, const std::string& owner, const std::string& aliasGroup)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  if (m_memoryObjectIds.find(bufferName) != m_memoryObjectIds.end())
+  {
+    LOG_ERROR("Buffer {} already existing", bufferName);
+    return {};
+  }
+
+  if (m_arena() != nullptr)
+  {
+    LOG_ERROR("Cannot create buffer {}, arena is already allocated", bufferName);
+    return {};
+  }
+
+  // Actual buffer is only known once the whole arena layout is
+  const BufferHandle handle = registerMemoryObject(bufferName, memoryKind::BUFFER, cl::Buffer(), cl::Image2D(), bufferSize, 0, owner);
+
+  const auto slotIt = aliasGroup.empty() ? m_arenaSlots.end() : std::find_if(m_arenaSlots.begin(), m_arenaSlots.end(), [&](const arenaSlot& slot)
+                                                                                 { return slot.aliasGroup == aliasGroup; });
+
+  if (slotIt == m_arenaSlots.end())
+  {
+    m_arenaSlots.push_back({ aliasGroup, bufferSize, bufferSize, { handle.id } });
+  }
+  else
+  {
+    slotIt->size = std::max(slotIt->size, bufferSize);
+    slotIt->requestedSize += bufferSize;
+    slotIt->memoryObjectIds.push_back(handle.id);
+  }
+
+  return handle;
+}
+
+bool Physics::CL::Context::allocateArena(cl_mem_flags memoryFlags)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (m_arena() != nullptr)
+  {
+    LOG_ERROR("Arena already allocated");
+    return false;
+  }
+
+  if (m_arenaSlots.empty())
+    return true;
+
+  // Sub-buffer origins must be aligned on the device base address alignment, given in bits
+  const size_t alignment = cl_device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8;
+
+  std::vector<size_t> offsets;
+  size_t arenaSize = 0;
+  size_t requestedSize = 0;
+  size_t numBuffers = 0;
+
+  for (const auto& slot : m_arenaSlots)
+  {
+    offsets.push_back(arenaSize);
+    arenaSize += (slot.size + alignment - 1) / alignment * alignment;
+    requestedSize += slot.requestedSize;
+    numBuffers += slot.memoryObjectIds.size();
+  }
+
+  // Whole layout is known, refused before anything is allocated
+  if (!reserveMemory("arena", "Context", arenaSize))
+    return false;
+
+  // Sub-buffers inherit the host placement, it cannot be given to them
+  const cl_mem_flags arenaFlags = getAllocationFlags(memoryFlags);
+
+  cl_int err;
+  m_arena = cl::Buffer(cl_context, arenaFlags, arenaSize, nullptr, &err);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot allocate arena of " + std::to_string(arenaSize) + " bytes");
+    return false;
+  }
+
+  for (size_t i = 0; i < m_arenaSlots.size(); ++i)
+  {
+    const auto& slot = m_arenaSlots[i];
+
+    const cl_buffer_region region { offsets[i], slot.size };
+    cl::Buffer subBuffer = m_arena.createSubBuffer(memoryFlags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    if (err != CL_SUCCESS)
+    {
+      CL_ERROR(err, "Cannot create sub-buffer for " + m_memoryObjects[slot.memoryObjectIds.front()].name);
+      return false;
+    }
+
+    // Aliases share the same buffer object, so they are also ordered as one on an out-of-order queue
+    for (const auto id : slot.memoryObjectIds)
+    {
+      m_memoryObjects[id].buffer = subBuffer;
+      m_memoryObjects[id].isAliased = (slot.memoryObjectIds.size() > 1);
+      m_memoryObjects[id].flags = arenaFlags;
+    }
+  }
+
+  LOG_INFO("Allocated arena of {} bytes for {} buffers, {} bytes saved by aliasing", arenaSize, numBuffers, (requestedSize > arenaSize) ? requestedSize - arenaSize : 0);
+  return true;
+}
+
+Physics::CL::BufferHandle Physics::CL::Context::createImage2D(const std::string& name, imageSpecs specs, cl_mem_flags memoryFlags, const std::string& owner)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  cl_int err;
+
+  if (m_memoryObjectIds.find(name) != m_memoryObjectIds.end())
+  {
+    LOG_ERROR("Image {} already existing", name);
+    return {};
+  }
+
+  cl::ImageFormat format(specs.channelOrder, specs.channelType);
+
+  auto image = cl::Image2D(cl_context, memoryFlags, format, specs.width, specs.height, 0, nullptr, &err);
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot create image {}", name);
+    return {};
+  }
+
+  // Backing store is only allocated on first use, the object can still be dropped
+  const size_t imageSize = image.getInfo<CL_MEM_SIZE>();
+  if (!reserveMemory(name, owner, imageSize))
+    return {};
+
+  return registerMemoryObject(name, memoryKind::IMAGE_2D, cl::Buffer(), image, imageSize, memoryFlags, owner);
+}
+
+Physics::CL::BufferHandle Physics::CL::Context::createGLBuffer(const std::string& GLBufferName, unsigned int VBOIndex, cl_mem_flags memoryFlags, const std::string& owner)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  cl_int err;
+
+  if (!m_isGLInteropEnabled)
+  {
+    LOG_ERROR("Cannot create GL buffer {} without GL sharing", GLBufferName);
+    return {};
+  }
+
+  if (m_memoryObjectIds.find(GLBufferName) != m_memoryObjectIds.end())
+  {
+    LOG_ERROR("GL buffer {} already existing", GLBufferName);
+    return {};
+  }
+
+  auto GLBuffer = cl::BufferGL(cl_context, memoryFlags, (cl_GLuint)VBOIndex, &err);
+
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot create GL buffer " + GLBufferName);
+    return {};
+  }
+
+  // Allocated by GL, but still taken from the same device memory
+  const size_t GLBufferSize = GLBuffer.getInfo<CL_MEM_SIZE>();
+  if (!reserveMemory(GLBufferName, owner, GLBufferSize))
+    return {};
+
+  return registerMemoryObject(GLBufferName, memoryKind::BUFFER_GL, GLBuffer, cl::Image2D(), GLBufferSize, memoryFlags, owner);
+}
+
+bool Physics::CL::Context::loadBufferFromHost(BufferHandle buffer, size_t offset, size_t sizeToFill, const void* hostPtr)
+{
+  std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].kind == memoryKind::IMAGE_2D)
+  {
+    LOG_ERROR("Cannot load unexisting buffer {}", buffer.id);
+    return false;
+  }
+
+  const auto& destBuffer = m_memoryObjects[buffer.id];
+
+  auto& queue = getTransferQueue(destBuffer.kind);
+  const memoryAccesses accesses { { destBuffer.buffer(), argAccess::WRITE } };
+  const auto dependencies = getTransferDependencies(queue, accesses);
+
+  // Complete on return, host memory can be reused freely
+  cl::Event event;
+  cl_int err = queue.enqueueWriteBuffer(destBuffer.buffer, CL_FALSE, offset, sizeToFill, hostPtr, asWaitList(dependencies), &event);
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot load buffer {}", destBuffer.name);
+    return false;
+  }
+
+  trackTransfer(queue, accesses, event);
+  queue.flush();
+
+  // Other threads keep submitting while this one waits
+  lock.unlock();
+  err = event.wait();
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot wait for load of buffer " + std::to_string(buffer.id));
+    return false;
+  }
+
+  return true;
+}
+
+bool Physics::CL::Context::unloadBufferFromDevice(BufferHandle buffer, size_t offset, size_t sizeToFill, void* hostPtr)
+{
+  std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].kind == memoryKind::IMAGE_2D)
+  {
+    LOG_ERROR("Cannot unload unexisting buffer {}", buffer.id);
+    return false;
+  }
+
+  const auto& srcBuffer = m_memoryObjects[buffer.id];
+
+  auto& queue = getTransferQueue(srcBuffer.kind);
+  const memoryAccesses accesses { { srcBuffer.buffer(), argAccess::READ } };
+  const auto dependencies = getTransferDependencies(queue, accesses);
+
+  // Complete on return, later commands can overwrite the buffer freely
+  cl::Event event;
+  cl_int err = queue.enqueueReadBuffer(srcBuffer.buffer, CL_FALSE, offset, sizeToFill, hostPtr, asWaitList(dependencies), &event);
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot unload buffer {}", srcBuffer.name);
+    return false;
+  }
+
+  queue.flush();
+
+  // Other threads keep submitting while this one waits
+  lock.unlock();
+  err = event.wait();
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot wait for unload of buffer " + std::to_string(buffer.id));
+    return false;
+  }
+
+  return true;
+}
+
+bool Physics::CL::Context::swapBuffers(BufferHandle bufferA, BufferHandle bufferB)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(bufferA) || m_memoryObjects[bufferA.id].kind != memoryKind::BUFFER)
+  {
+    LOG_ERROR("Cannot swap buffers, buffer {} not existing", bufferA.id);
+    return false;
+  }
+
+  if (!isValid(bufferB) || m_memoryObjects[bufferB.id].kind != memoryKind::BUFFER)
+  {
+    LOG_ERROR("Cannot swap buffers, buffer {} not existing", bufferB.id);
+    return false;
+  }
+
+  if (m_memoryObjects[bufferA.id].isAliased || m_memoryObjects[bufferB.id].isAliased)
+  {
+    LOG_ERROR("Cannot swap buffers {} and {}, aliased buffers must stay in place", m_memoryObjects[bufferA.id].name, m_memoryObjects[bufferB.id].name);
+    return false;
+  }
+
+  // Only the underlying OpenCL buffers are swapped, handles and names stay in place
+  std::swap(m_memoryObjects[bufferA.id].buffer, m_memoryObjects[bufferB.id].buffer);
+
+  // Kernels bound by name or handle keep following the handle, only the args bound to these two are visited
+  rebindSwappedArgs(bufferA, bufferB);
+
+  if (isRecording())
+  {
+    recordedCommand command { commandType::SWAP };
+    command.bufferA = bufferA;
+    command.bufferB = bufferB;
+    m_commandLists[m_recordingList.id].commands.push_back(std::move(command));
+  }
+
+  return true;
+}
+
+void Physics::CL::Context::rebindSwappedArgs(BufferHandle bufferA, BufferHandle bufferB)
+{
+  // Each buffer now has the memory the other one had
+  const std::array<std::pair<BufferHandle, const cl::Memory*>, 2> swapped { { { bufferA, &m_memoryObjects[bufferB.id].buffer },
+                                                                              { bufferB, &m_memoryObjects[bufferA.id].buffer } } };
+
+  // Entries set to something else since are dropped before any rebind, a slot moved from one buffer to the other
+  // must not be seen as still bound to the first one
+  std::array<std::vector<std::pair<KernelHandle, cl_uint>>*, 2> bufferArgs { nullptr, nullptr };
+  for (size_t i = 0; i < swapped.size(); ++i)
+  {
+    const auto it = m_bufferArgs.find(swapped[i].first.id);
+    if (it == m_bufferArgs.end())
+      continue;
+
+    const cl::Memory& previousMemory = *swapped[i].second;
+    std::erase_if(it->second, [&](const std::pair<KernelHandle, cl_uint>& bufferArg)
+                  { return m_kernels[bufferArg.first.id].args[bufferArg.second].memory() != previousMemory(); });
+    bufferArgs[i] = &it->second;
+  }
+
+  for (size_t i = 0; i < swapped.size(); ++i)
+  {
+    if (bufferArgs[i] == nullptr)
+      continue;
+
+    const cl::Memory& memory = m_memoryObjects[swapped[i].first.id].buffer;
+    for (const auto& [kernel, argIndex] : *bufferArgs[i])
+    {
+      auto& kernelObj = m_kernels[kernel.id];
+      if (kernelObj.kernel.setArg(argIndex, memory) != CL_SUCCESS)
+      {
+        LOG_ERROR("Cannot rebind arg {} for kernel {} after a swap", argIndex, kernelObj.name);
+        continue;
+      }
+      ++m_frameArgStats.nbSet;
+      kernelObj.args[argIndex].memory = memory;
+    }
+  }
+}
+
+void Physics::CL::Context::addBufferArg(BufferHandle buffer, KernelHandle kernel, cl_uint argIndex)
+{
+  auto& bufferArgs = m_bufferArgs[buffer.id];
+  const std::pair<KernelHandle, cl_uint> bufferArg { kernel, argIndex };
+  if (std::find(bufferArgs.begin(), bufferArgs.end(), bufferArg) == bufferArgs.end())
+    bufferArgs.push_back(bufferArg);
+}
+
+bool Physics::CL::Context::copyBuffer(BufferHandle srcBuffer, BufferHandle dstBuffer, size_t sizeToCopy)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  cl_int err;
+
+  if (!isValid(srcBuffer) || m_memoryObjects[srcBuffer.id].kind == memoryKind::IMAGE_2D)
+  {
+    LOG_ERROR("Cannot copy buffers, source buffer {} not existing", srcBuffer.id);
+    return false;
+  }
+
+  if (!isValid(dstBuffer) || m_memoryObjects[dstBuffer.id].kind != memoryKind::BUFFER)
+  {
+    LOG_ERROR("Cannot copy buffers, destination buffer {} not existing", dstBuffer.id);
+    return false;
+  }
+
+  const auto& src = m_memoryObjects[srcBuffer.id];
+  const auto& dst = m_memoryObjects[dstBuffer.id];
+
+  size_t dstBufferSize;
+  err = dst.buffer.getInfo(CL_MEM_SIZE, &dstBufferSize);
+
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot get size from buffer " + dst.name);
+    return false;
+  }
+
+  size_t srcBufferSize;
+  err = src.buffer.getInfo(CL_MEM_SIZE, &srcBufferSize);
+
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot get size from buffer" + src.name);
+    return false;
+  }
+
+  if (sizeToCopy == 0 && dstBufferSize > srcBufferSize)
+  {
+    LOG_ERROR("Source buffer {} with size {} is smaller than destination buffer {} with size {} ", src.name, srcBufferSize, dst.name, dstBufferSize);
+    return false;
+  }
+
+  if (sizeToCopy > std::min(srcBufferSize, dstBufferSize))
+  {
+    LOG_ERROR("Cannot copy {} bytes from buffer {} with size {} to buffer {} with size {}", sizeToCopy, src.name, srcBufferSize, dst.name, dstBufferSize);
+    return false;
+  }
+
+  const size_t copySize = (sizeToCopy > 0) ? sizeToCopy : dstBufferSize;
+
+  if (!waitForTransfers())
+    return false;
+
+  memoryAccesses accesses { { src.buffer(), argAccess::READ }, { dst.buffer(), argAccess::WRITE } };
+  const auto dependencies = getDependencies(accesses);
+
+  // Only copying the amount of data which can fit into the destination buffer
+  cl::Event event;
+  err = cl_queue.enqueueCopyBuffer(src.buffer, dst.buffer, 0, 0, copySize, asWaitList(dependencies), m_isOutOfOrder ? &event : nullptr);
+
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot copy buffer " + src.name + " to buffer " + dst.name);
+    return false;
+  }
+
+  trackDependencies(accesses, event);
+
+  if (isRecording())
+  {
+    recordedCommand command { commandType::COPY };
+    command.src = src.buffer;
+    command.dst = dst.buffer;
+    command.size = copySize;
+    command.accesses = std::move(accesses);
+    m_commandLists[m_recordingList.id].commands.push_back(std::move(command));
+  }
+
+  return true;
+}
+
+Physics::CL::KernelHandle Physics::CL::Context::cloneKernel(KernelHandle kernel)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  if (!isValid(kernel))
+  {
+    LOG_ERROR("Cannot clone unexisting Kernel {}", kernel.id);
+    return {};
+  }
+
+  // Copied, the registry grows below
+  kernelObject clone = m_kernels[kernel.id];
+
+  cl_int err;
+  clone.kernel = instantiateKernel(clone, err);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot clone kernel " + clone.name);
+    return {};
+  }
+
+  // Same name for profiling and recording, but only the original is found by name
+  const KernelHandle handle { static_cast<uint32_t>(m_kernels.size()) };
+  m_kernels.push_back(std::move(clone));
+
+  // Bound to the same buffers as the original, it follows their swaps too
+  for (auto& [bufferId, bufferArgs] : m_bufferArgs)
+  {
+    const size_t numBufferArgs = bufferArgs.size();
+    for (size_t i = 0; i < numBufferArgs; ++i)
+    {
+      if (bufferArgs[i].first != kernel)
+        continue;
+
+      const cl_uint argIndex = bufferArgs[i].second;
+      bufferArgs.emplace_back(handle, argIndex);
+    }
+  }
+
+  return handle;
+}
+
+Physics::CL::KernelHandle Physics::CL::Context::createKernel(const std::string& programName, const std::string& kernelName, const std::vector<std::string>& argNames, const std::string& instanceName)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  // Named args are bound to buffers here, empty names are left for setKernelArg by handle or value
+
+  if (!m_init)
+    return {};
+
+  cl_int err;
+
+  // Kernel objects keep their kernel name, recorded launches create their instances from it
+  const std::string& registeredName = instanceName.empty() ? kernelName : instanceName;
+  if (m_kernelIds.find(registeredName) != m_kernelIds.end())
+  {
+    LOG_ERROR("OpenCL kernel already existing {}", registeredName);
+    return {};
+  }
+
+  // Only blocks until this program is built, others keep building in the background
+  cl::Program program;
+  if (!waitForProgram(programName, program))
+    return {};
+
+  auto kernel = cl::Kernel(program, kernelName.c_str(), &err);
+
+  if (err != CL_SUCCESS)
+  {
     CL_ERROR(err, "Cannot create kernel " + kernelName);
+    return {};
+  }
+
+  std::vector<kernelArg> args(kernel.getInfo<CL_KERNEL_NUM_ARGS>());
+
+  // Only known if the program has been built with arg infos, read-write is always a safe guess
+  if (m_isOutOfOrder)
+  {
+    for (cl_uint i = 0; i < args.size(); ++i)
+    {
+      cl_kernel_arg_type_qualifier qualifier = 0;
+      if (kernel.getArgInfo(i, CL_KERNEL_ARG_TYPE_QUALIFIER, &qualifier) == CL_SUCCESS && (qualifier & CL_KERNEL_ARG_TYPE_CONST))
+        args[i].access = argAccess::READ;
+    }
+  }
+
+  for (cl_uint i = 0; i < argNames.size(); ++i)
+  {
+    if (argNames[i].empty())
+      continue;
+
+    const auto it = m_memoryObjectIds.find(argNames[i]);
+    if (it == m_memoryObjectIds.end())
+    {
+      LOG_ERROR("For kernel {} arg not existing {}", kernelName, argNames[i]);
+      return {};
+    }
+
+    const auto& memory = m_memoryObjects[it->second].memory();
+    kernel.setArg(i, memory);
+    if (i < args.size())
+    {
+      args[i].size = sizeof(cl_mem);
+      args[i].memory = memory;
+    }
+  }
+
+  const KernelHandle handle { static_cast<uint32_t>(m_kernels.size()) };
+
+  m_kernels.push_back({ kernelName, kernel, std::move(args) });
+  m_kernelIds.insert(std::make_pair(registeredName, handle.id));
+
+  for (cl_uint i = 0; i < argNames.size() && i < m_kernels[handle.id].args.size(); ++i)
+  {
+    if (!argNames[i].empty())
+      addBufferArg({ m_memoryObjectIds[argNames[i]] }, handle, i);
+  }
+
+  return handle;
+}
+
+bool Physics::CL::Context::setKernelArg(KernelHandle kernel, cl_uint argIndex, size_t argSize, const void* value)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(kernel))
+  {
+    LOG_ERROR("Cannot set arg {} for unexisting Kernel {}", argIndex, kernel.id);
+    return false;
+  }
+
+  auto& kernelObj = m_kernels[kernel.id];
+
+  // Same size and bytes, or same local memory size
+  if (argIndex < kernelObj.args.size())
+  {
+    const auto& arg = kernelObj.args[argIndex];
+    const bool isSameValue = (value != nullptr) ? (arg.value.size() == argSize && std::memcmp(arg.value.data(), value, argSize) == 0)
+                                                : arg.value.empty();
+    if (arg.size == argSize && arg.memory() == nullptr && isSameValue)
+    {
+      ++m_frameArgStats.nbElided;
+      return true;
+    }
+  }
+
+  cl_int err = kernelObj.kernel.setArg(argIndex, argSize, value);
+  ++m_frameArgStats.nbSet;
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot set arg {} for kernel {} ", argIndex, kernelObj.name);
+    return false;
+  }
+
+  if (argIndex >= kernelObj.args.size())
+    kernelObj.args.resize(argIndex + 1);
+
+  // Null value is a local memory allocation
+  auto& arg = kernelObj.args[argIndex];
+  arg.size = argSize;
+  arg.memory = cl::Memory();
+  if (value != nullptr)
+    arg.value.assign(static_cast<const unsigned char*>(value), static_cast<const unsigned char*>(value) + argSize);
+  else
+    arg.value.clear();
+
+  return true;
+}
+
+bool Physics::CL::Context::setKernelArg(KernelHandle kernel, cl_uint argIndex, BufferHandle buffer)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(kernel))
+  {
+    LOG_ERROR("Cannot set arg {} for unexisting Kernel {}", argIndex, kernel.id);
+    return false;
+  }
+
+  auto& kernelObj = m_kernels[kernel.id];
+
+  if (!isValid(buffer))
+  {
+    LOG_ERROR("For kernel {} arg {} not existing", kernelObj.name, argIndex);
+    return false;
+  }
+
+  const auto& memory = m_memoryObjects[buffer.id].memory();
+
+  if (argIndex < kernelObj.args.size() && kernelObj.args[argIndex].memory() == memory())
+  {
+    ++m_frameArgStats.nbElided;
+    return true;
+  }
+
+  cl_int err = kernelObj.kernel.setArg(argIndex, memory);
+  ++m_frameArgStats.nbSet;
+
+  if (err != CL_SUCCESS)
+  {
+    LOG_ERROR("Cannot set arg {} for kernel {} ", argIndex, kernelObj.name);
+    return false;
+  }
+
+  if (argIndex >= kernelObj.args.size())
+    kernelObj.args.resize(argIndex + 1);
+
+  auto& arg = kernelObj.args[argIndex];
+  arg.size = sizeof(cl_mem);
+  arg.value.clear();
+  arg.memory = memory;
+
+  addBufferArg(buffer, kernel, argIndex);
+
+  return true;
+}
+
+bool Physics::CL::Context::setKernelArgAccess(KernelHandle kernel, cl_uint argIndex, argAccess access)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!isValid(kernel))
+  {
+    LOG_ERROR("Cannot set arg {} access for unexisting Kernel {}", argIndex, kernel.id);
+    return false;
+  }
+
+  auto& kernelObj = m_kernels[kernel.id];
+
+  if (argIndex >= kernelObj.args.size())
+  {
+    LOG_ERROR("Cannot set access for arg {} of kernel {}, arg not existing", argIndex, kernelObj.name);
+    return false;
+  }
+
+  kernelObj.args[argIndex].access = access;
+  return true;
+}
+
+bool Physics::CL::Context::runKernel(KernelHandle kernel, size_t numGlobalWorkItems, size_t numLocalWorkItems)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(kernel))
+  {
+    LOG_ERROR("Cannot run unexisting Kernel {}", kernel.id);
+    return false;
+  }
+
+  // Tuning the first launch drains the queue, it must happen before waiting for anything
+  const size_t localSize = (numLocalWorkItems > 0) ? numLocalWorkItems : getLocalSize(kernel, numGlobalWorkItems);
+
+  const auto& kernelObj = m_kernels[kernel.id];
+
+  cl::Event event;
+  cl::NDRange global(numGlobalWorkItems);
+  cl::NDRange local = (localSize > 0) ? cl::NDRange(localSize) : cl::NullRange;
+
+  if (!waitForTransfers())
+    return false;
+
+  cl_int err;
+
+  const memoryAccesses accesses = getKernelAccesses(kernelObj);
+  const auto dependencies = getDependencies(accesses);
+
+  // Event only needed to get back profiling infos and to order later commands
+  err = cl_queue.enqueueNDRangeKernel(kernelObj.kernel, cl::NullRange, global, local, asWaitList(dependencies), (m_isKernelProfilingEnabled || m_isOutOfOrder) ? &event : nullptr);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Failure of kernel " + kernelObj.name + " while running");
+    return false;
+  }
+
+  trackDependencies(accesses, event);
+
+  if (m_isKernelProfilingEnabled)
+    m_profiler.record(kernel, kernelObj.name, event);
+
+  if (isRecording())
+    recordKernel(kernel, global, local);
+
+  return true;
+}
+
+bool Physics::CL::Context::interactWithGLBuffers(const std::vector<BufferHandle>& GLBufferHandles, interOpCLGL interaction)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  // Nothing shared with GL, buffers are always owned by OpenCL
+  if (!m_isGLInteropEnabled)
+    return true;
+
+  std::vector<cl::Memory> GLBuffers;
+  GLBuffers.reserve(GLBufferHandles.size());
+
+  for (const auto& GLBuffer : GLBufferHandles)
+  {
+    if (!isValid(GLBuffer) || m_memoryObjects[GLBuffer.id].kind != memoryKind::BUFFER_GL)
+    {
+      LOG_ERROR("error GL buffer not existing");
+      return false;
+    }
+    else
+    {
+      GLBuffers.push_back(m_memoryObjects[GLBuffer.id].buffer);
+    }
+  }
+
+  if (!enqueueGLInteraction(GLBuffers, interaction))
+    return false;
+
+  std::string allNames;
+  std::for_each(GLBufferHandles.cbegin(), GLBufferHandles.cend(), [&](const BufferHandle& handle)
+      { return allNames += m_memoryObjects[handle.id].name + " "; });
+  LOG_DEBUG(interaction == interOpCLGL::ACQUIRE ? "GL buffers acquired {}" : "GL buffers released {}", allNames);
+
+  if (isRecording())
+  {
+    recordedCommand command { (interaction == interOpCLGL::ACQUIRE) ? commandType::ACQUIRE_GL : commandType::RELEASE_GL };
+    command.GLObjects = std::move(GLBuffers);
+    m_commandLists[m_recordingList.id].commands.push_back(std::move(command));
+  }
+
+  return true;
+}
+
+bool Physics::CL::Context::enqueueGLInteraction(const std::vector<cl::Memory>& GLObjects, interOpCLGL interaction)
+{
+  if (!waitForTransfers())
+    return false;
+
+  memoryAccesses accesses;
+  if (m_isOutOfOrder)
+  {
+    for (const auto& GLObject : GLObjects)
+      accesses.emplace_back(GLObject(), argAccess::READ_WRITE);
+  }
+  auto dependencies = getDependencies(accesses);
+
+  // GL may still be rendering with the buffers
+  if (interaction == interOpCLGL::ACQUIRE && m_GLFenceEvent() != nullptr)
+  {
+    dependencies.push_back(m_GLFenceEvent);
+    m_GLFenceEvent = cl::Event();
+  }
+
+  cl::Event event;
+  cl::Event* eventPtr = m_isOutOfOrder ? &event : nullptr;
+  cl_int err = (interaction == interOpCLGL::ACQUIRE) ? cl_queue.enqueueAcquireGLObjects(&GLObjects, asWaitList(dependencies), eventPtr)
+                                                     : cl_queue.enqueueReleaseGLObjects(&GLObjects, asWaitList(dependencies), eventPtr);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot interact with GL buffers");
+    return false;
+  }
+
+  trackDependencies(accesses, event);
+
+  if (interaction == interOpCLGL::RELEASE)
+  {
+    // cl_khr_gl_event makes GL commands issued after the release wait for it, they only need to be submitted.
+    // Otherwise must flush and finish queue to make sure GL buffers have been released
+    if (m_isGLEventSupported)
+    {
+      err = cl_queue.flush();
+      if (err != CL_SUCCESS)
+      {
+        CL_ERROR(err, "Cannot flush queue");
+        return false;
+      }
+    }
+    else
+    {
+      finishTasks();
+    }
+  }
+
+  return true;
+}
+
+bool Physics::CL::Context::setGLFence(cl_GLsync fence)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  // GL never uses OpenCL buffers, nothing to wait for
+  if (!m_isGLInteropEnabled)
+    return true;
+
+  if (!m_isGLEventSupported || fence == nullptr)
+    return false;
+
+  // Program target is OpenCL 1.2, extension entry point is looked up like any other, on the platform of this context
+  using createEventFromGLsyncKHR = cl_event(CL_API_CALL*)(cl_context, cl_GLsync, cl_int*);
+  const auto clCreateEventFromGLsyncKHR = reinterpret_cast<createEventFromGLsyncKHR>(
+      clGetExtensionFunctionAddressForPlatform(cl_platform(), "clCreateEventFromGLsyncKHR"));
+
+  if (clCreateEventFromGLsyncKHR == nullptr)
+  {
+    LOG_ERROR("Cannot find clCreateEventFromGLsyncKHR entry point");
+    return false;
+  }
+
+  cl_int err;
+  cl_event event = clCreateEventFromGLsyncKHR(cl_context(), fence, &err);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot create event from GL fence");
+    return false;
+  }
+
+  // Takes ownership of the event
+  m_GLFenceEvent = cl::Event(event);
+  return true;
+}
+
+Physics::CL::CommandListHandle Physics::CL::Context::createCommandList(const std::string& name)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return {};
+
+  const CommandListHandle handle { static_cast<uint32_t>(m_commandLists.size()) };
+  m_commandLists.push_back({ name });
+
+  return handle;
+}
+
+bool Physics::CL::Context::beginRecording(CommandListHandle list)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isValid(list))
+  {
+    LOG_ERROR("Cannot record unexisting command list {}", list.id);
+    return false;
+  }
+
+  if (m_recordingList.isValid())
+  {
+    LOG_ERROR("Cannot record command list {}, {} is already being recorded", m_commandLists[list.id].name, m_commandLists[m_recordingList.id].name);
+    return false;
+  }
+
+  auto& commandList = m_commandLists[list.id];
+  commandList.commands.clear();
+  commandList.isRecorded = false;
+
+  m_recordingBuffers.clear();
+  for (const auto& memoryObject : m_memoryObjects)
+    m_recordingBuffers.push_back(memoryObject.buffer());
+
+  m_recordingList = list;
+  m_recordingThread = std::this_thread::get_id();
+
+  return true;
+}
+
+bool Physics::CL::Context::endRecording()
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!isRecording())
+  {
+    LOG_ERROR("No command list being recorded by this thread");
+    return false;
+  }
+
+  auto& commandList = m_commandLists[m_recordingList.id];
+  m_recordingList = {};
+
+  // Swaps must cancel each other, otherwise next replay would start from other buffers than the recorded ones
+  for (size_t i = 0; i < m_recordingBuffers.size(); ++i)
+  {
+    if (m_memoryObjects[i].buffer() != m_recordingBuffers[i])
+    {
+      LOG_ERROR("Command list {} does not leave buffer {} in place, it cannot be replayed", commandList.name, m_memoryObjects[i].name);
+      commandList.commands.clear();
+      return false;
+    }
+  }
+
+  commandList.isRecorded = true;
+  LOG_INFO("Recorded command list {} with {} commands", commandList.name, commandList.commands.size());
+
+  return true;
+}
+
+void Physics::CL::Context::invalidateCommandList(CommandListHandle list)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!isValid(list))
+    return;
+
+  m_commandLists[list.id].commands.clear();
+  m_commandLists[list.id].isRecorded = false;
+}
+
+void Physics::CL::Context::recordKernel(KernelHandle kernel, const cl::NDRange& global, const cl::NDRange& local)
+{
+  const auto& kernelObj = m_kernels[kernel.id];
+
+  // Same kernel can be launched several times with different args, each launch gets its own instance
+  cl_int err;
+  cl::Kernel boundKernel = instantiateKernel(kernelObj, err);
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot record kernel " + kernelObj.name);
+    return;
+  }
+
+  recordedCommand command { commandType::KERNEL };
+  command.kernel = kernel;
+  command.boundKernel = boundKernel;
+  command.global = global;
+  command.local = local;
+  command.accesses = getKernelAccesses(kernelObj);
+  m_commandLists[m_recordingList.id].commands.push_back(std::move(command));
+}
+
+cl::Kernel Physics::CL::Context::instantiateKernel(const kernelObject& kernelObj, cl_int& err) const
+{
+  cl::Kernel instance(kernelObj.kernel.getInfo<CL_KERNEL_PROGRAM>(), kernelObj.name.c_str(), &err);
+  if (err != CL_SUCCESS)
+    return instance;
+
+  for (cl_uint i = 0; i < kernelObj.args.size(); ++i)
+  {
+    const auto& arg = kernelObj.args[i];
+    if (arg.size == 0)
+      continue;
+
+    if (arg.memory() != nullptr)
+      err = instance.setArg(i, arg.memory);
+    else
+      err = instance.setArg(i, arg.size, arg.value.empty() ? nullptr : arg.value.data());
+
+    if (err != CL_SUCCESS)
+      return instance;
+  }
+
+  return instance;
+}
+
+bool Physics::CL::Context::replayCommandList(CommandListHandle list)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init)
+    return false;
+
+  if (!isRecorded(list))
+  {
+    LOG_ERROR("Cannot replay command list {}, it has not been recorded", list.id);
     return false;
   }
 
-  for (cl_uint i = 0; i < argNames.size(); ++i)
+  const auto& commandList = m_commandLists[list.id];
+
+  // Recorded commands only know about their buffers on an out-of-order queue, otherwise wait for all uploads
+  if (!waitForTransfers())
+    return false;
+
+  for (const auto& command : commandList.commands)
   {
-    if (argNames[i].empty())
-      continue;
+    cl_int err = CL_SUCCESS;
+    cl::Event event;
 
-    auto it = m_buffersMap.find(argNames[i]);
-    auto itGL = m_GLBuffersMap.find(argNames[i]);
-    auto itIm = m_imagesMap.find(argNames[i]);
-    if (it != m_buffersMap.end())
+    switch (command.type)
     {
-      kernel.setArg(i, it->second);
-    }
-    else if (itGL != m_GLBuffersMap.end())
+    case commandType::KERNEL:
     {
-      kernel.setArg(i, itGL->second);
+      const auto dependencies = getDependencies(command.accesses);
+      err = cl_queue.enqueueNDRangeKernel(command.boundKernel, cl::NullRange, command.global, command.local, asWaitList(dependencies), (m_isKernelProfilingEnabled || m_isOutOfOrder) ? &event : nullptr);
+      if (err == CL_SUCCESS && m_isKernelProfilingEnabled)
+        m_profiler.record(command.kernel, m_kernels[command.kernel.id].name, event);
+      break;
     }
-    else if (itIm != m_imagesMap.end())
+    case commandType::COPY:
     {
-      kernel.setArg(i, itIm->second);
+      const auto dependencies = getDependencies(command.accesses);
+      err = cl_queue.enqueueCopyBuffer(command.src, command.dst, 0, 0, command.size, asWaitList(dependencies), m_isOutOfOrder ? &event : nullptr);
+      break;
     }
-    else
+    case commandType::SWAP:
+      // Recorded launches have their own bound kernels, and swaps of a frame cancel each other, so live kernel args
+      // are already right once the list is replayed
+      std::swap(m_memoryObjects[command.bufferA.id].buffer, m_memoryObjects[command.bufferB.id].buffer);
+      break;
+    case commandType::ACQUIRE_GL:
+    case commandType::RELEASE_GL:
+      if (!enqueueGLInteraction(command.GLObjects, (command.type == commandType::ACQUIRE_GL) ? interOpCLGL::ACQUIRE : interOpCLGL::RELEASE))
+        return false;
+      break;
+    }
+
+    if (err != CL_SUCCESS)
     {
-      LOG_ERROR("For kernel {} arg not existing {}", kernelName, argNames[i]);
+      CL_ERROR(err, "Failure while replaying command list " + commandList.name);
       return false;
     }
-  }
 
-  m_kernelsMap.insert(std::make_pair(kernelName, kernel));
+    trackDependencies(command.accesses, event);
+  }
 
   return true;
 }
 
-bool Physics::CL::Context::setKernelArg(std::string kernelName, cl_uint argIndex, size_t argSize, const void* value)
+bool Physics::CL::Context::mapAndSendBufferToDevice(BufferHandle buffer, const void* bufferPtr, size_t bufferSize)
 {
-  if (!m_init)
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+  if (!m_init || bufferPtr == nullptr)
     return false;
 
-  auto it = m_kernelsMap.find(kernelName);
-  if (it == m_kernelsMap.end())
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].kind != memoryKind::BUFFER)
   {
-    LOG_ERROR("Cannot set arg {} for unexisting Kernel {}", argIndex, kernelName);
+    LOG_ERROR("error buffer not existing");
     return false;
   }
 
-  auto kernel = it->second;
-  cl_int err = kernel.setArg(argIndex, argSize, value);
+  const auto& bufferObj = m_memoryObjects[buffer.id];
 
-  if (err != CL_SUCCESS)
+  auto& queue = getTransferQueue(bufferObj.kind);
+  const memoryAccesses accesses { { bufferObj.buffer(), argAccess::WRITE } };
+  const auto dependencies = getTransferDependencies(queue, accesses);
+
+  cl_int err;
+  void* mappedMemory = queue.enqueueMapBuffer(bufferObj.buffer, CL_TRUE, CL_MAP_WRITE, 0, bufferSize, asWaitList(dependencies), nullptr, &err);
+  if (err < 0)
+  {
+    CL_ERROR(err, "Cannot map buffer " + bufferObj.name + " to host memory");
+    return false;
+  }
+  memcpy(mappedMemory, bufferPtr, bufferSize);
+  cl::Event event;
+  err = queue.enqueueUnmapMemObject(bufferObj.buffer, mappedMemory, nullptr, &event);
+  if (err < 0)
   {
-    LOG_ERROR("Cannot set arg {} for kernel {} ", argIndex, kernelName);
+    CL_ERROR(err, "Cannot unmap buffer" + bufferObj.name);
     return false;
   }
 
+  trackTransfer(queue, accesses, event);
+
   return true;
 }
 
-bool Physics::CL::Context::setKernelArg(std::string kernelName, cl_uint argIndex, const std::string& argName)
+void* Physics::CL::Context::mapBuffer(BufferHandle buffer, size_t offset, size_t size, argAccess access)
 {
+  std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
   if (!m_init)
-    return false;
+    return nullptr;
 
-  auto itK = m_kernelsMap.find(kernelName);
-  if (itK == m_kernelsMap.end())
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].kind == memoryKind::IMAGE_2D)
   {
-    LOG_ERROR("Cannot set arg {} for unexisting Kernel {}", argName, kernelName);
-    return false;
+    LOG_ERROR("Cannot map unexisting buffer {}", buffer.id);
+    return nullptr;
   }
 
-  auto kernel = itK->second;
+  auto& bufferObj = m_memoryObjects[buffer.id];
 
-  auto itB = m_buffersMap.find(argName);
-  auto itBGL = m_GLBuffersMap.find(argName);
-  auto itIm = m_imagesMap.find(argName);
-
-  if (itB != m_buffersMap.end())
+  if (bufferObj.mappedPtr != nullptr)
   {
-    kernel.setArg(argIndex, itB->second);
+    LOG_ERROR("Buffer {} is already mapped", bufferObj.name);
+    return nullptr;
   }
-  else if (itBGL != m_GLBuffersMap.end())
+
+  if (offset + size > bufferObj.size)
   {
-    kernel.setArg(argIndex, itBGL->second);
+    LOG_ERROR("Cannot map {} bytes at offset {} of buffer {}", size, offset, bufferObj.name);
+    return nullptr;
   }
-  else if (itIm != m_imagesMap.end())
+
+  auto& queue = getTransferQueue(bufferObj.kind);
+  const memoryAccesses accesses { { bufferObj.buffer(), access } };
+  const auto dependencies = getTransferDependencies(queue, accesses);
+
+  // Write only views do not need the current content
+  cl_map_flags mapFlags = CL_MAP_READ | CL_MAP_WRITE;
+  if (access == argAccess::READ)
+    mapFlags = CL_MAP_READ;
+  else if (access == argAccess::WRITE)
+    mapFlags = CL_MAP_WRITE_INVALIDATE_REGION;
+
+  cl_int err;
+  cl::Event event;
+  void* mappedPtr = queue.enqueueMapBuffer(bufferObj.buffer, CL_FALSE, mapFlags, offset, size, asWaitList(dependencies), &event, &err);
+  if (err != CL_SUCCESS)
   {
-    kernel.setArg(argIndex, itIm->second);
+    CL_ERROR(err, "Cannot map buffer " + bufferObj.name + " to host memory");
+    return nullptr;
   }
-  else
+
+  // Registered before waiting, the buffer cannot be mapped twice meanwhile
+  bufferObj.mappedPtr = mappedPtr;
+  bufferObj.mappedAccess = access;
+
+  queue.flush();
+
+  // Other threads keep submitting while this one waits
+  lock.unlock();
+  err = event.wait();
+  if (err != CL_SUCCESS)
   {
-    LOG_ERROR("For kernel {} arg not existing {}", kernelName, argName);
-    return false;
+    CL_ERROR(err, "Cannot wait for map of buffer " + std::to_string(buffer.id));
+
+    // Nothing mapped, the buffer can be mapped again. Memory objects may have moved while unlocked
+    lock.lock();
+    if (isValid(buffer) && m_memoryObjects[buffer.id].mappedPtr == mappedPtr)
+    {
+      m_memoryObjects[buffer.id].mappedPtr = nullptr;
+      m_memoryObjects[buffer.id].mappedAccess = argAccess::READ_WRITE;
+    }
+    return nullptr;
   }
 
-  return true;
+  return mappedPtr;
 }
 
-bool Physics::CL::Context::runKernel(std::string kernelName, size_t numGlobalWorkItems, size_t numLocalWorkItems)
+bool Physics::CL::Context::unmapBuffer(BufferHandle buffer)
 {
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
   if (!m_init)
     return false;
 
-  auto it = m_kernelsMap.find(kernelName);
-  if (it == m_kernelsMap.end())
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].mappedPtr == nullptr)
   {
-    LOG_ERROR("Cannot run unexisting Kernel {}", kernelName);
+    LOG_ERROR("Cannot unmap buffer {}, not mapped", buffer.id);
     return false;
   }
 
-  cl::Event event;
-  cl::NDRange global(numGlobalWorkItems);
-  cl::NDRange local = (numLocalWorkItems > 0) ? cl::NDRange(numLocalWorkItems) : cl::NullRange;
+  auto& bufferObj = m_memoryObjects[buffer.id];
 
-  cl_int err;
+  auto& queue = getTransferQueue(bufferObj.kind);
+  const memoryAccesses accesses { { bufferObj.buffer(), bufferObj.mappedAccess } };
+
+  cl::Event event;
+  cl_int err = queue.enqueueUnmapMemObject(bufferObj.buffer, bufferObj.mappedPtr, nullptr, &event);
+  bufferObj.mappedPtr = nullptr;
 
-  err = cl_queue.enqueueNDRangeKernel(it->second, cl::NullRange, global, local, nullptr, &event);
   if (err != CL_SUCCESS)
   {
-    CL_ERROR(err, "Failure of kernel " + kernelName + " while running");
+    CL_ERROR(err, "Cannot unmap buffer " + bufferObj.name);
     return false;
   }
 
-  if (m_isKernelProfilingEnabled)
+  // Read only views still have to be unmapped before the buffer is written again
+  trackTransfer(queue, accesses, event);
+
+  return true;
+}
+
+bool Physics::CL::Context::createReadback(BufferHandle buffer, size_t size)
+{
+  const auto srcName = m_memoryObjects[buffer.id].name;
+  const auto srcOwner = m_memoryObjects[buffer.id].owner;
+  auto& readback = m_readbacks[buffer.id];
+
+  for (size_t i = 0; i < readback.slots.size(); ++i)
   {
-    if (!finishTasks())
+    auto& slot = readback.slots[i];
+
+    slot.snapshot = createBuffer(srcName + "_snapshot" + std::to_string(i), size, CL_MEM_READ_WRITE, srcOwner);
+    if (!slot.snapshot.isValid())
       return false;
 
-    cl_ulong start = 0, end = 0;
-    event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-    event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-    //the resolution of the events is 1e-09 sec
-    double profilingTimeMs = (double)((cl_double)(end - start) * (1e-06));
+    // Host memory, not accounted in the device memory budget
+    cl_int err;
+    slot.pinned = cl::Buffer(cl_context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+      CL_ERROR(err, "Cannot create pinned buffer for " + srcName);
+      return false;
+    }
 
-    //if (profilingTimeMs > 1.0)
-    LOG_INFO("Profiling kernel {} : {} ms", kernelName, profilingTimeMs);
+    slot.hostPtr = cl_transferQueue.enqueueMapBuffer(slot.pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+      CL_ERROR(err, "Cannot map pinned buffer for " + srcName);
+      slot.hostPtr = nullptr;
+      return false;
+    }
   }
 
   return true;
 }
 
-bool Physics::CL::Context::interactWithGLBuffers(const std::vector<std::string>& GLBufferNames, interOpCLGL interaction)
+bool Physics::CL::Context::startReadback(BufferHandle buffer, size_t size)
 {
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
   if (!m_init)
     return false;
 
-  std::vector<cl::Memory> GLBuffers;
+  if (!isValid(buffer) || m_memoryObjects[buffer.id].kind != memoryKind::BUFFER)
+  {
+    LOG_ERROR("Cannot read back unexisting buffer {}", buffer.id);
+    return false;
+  }
 
-  for (const auto& GLBufferName : GLBufferNames)
+  if (size == 0 || size > m_memoryObjects[buffer.id].size)
   {
-    auto it = m_GLBuffersMap.find(GLBufferName);
-    if (it == m_GLBuffersMap.end())
-    {
-      LOG_ERROR("error GL buffer not existing");
-      return false;
-    }
-    else
+    LOG_ERROR("Cannot read back {} bytes of buffer {}", size, m_memoryObjects[buffer.id].name);
+    return false;
+  }
+
+  // Sized for the whole buffer, only the requested part is copied
+  if (m_readbacks.find(buffer.id) == m_readbacks.end() && !createReadback(buffer, m_memoryObjects[buffer.id].size))
+  {
+    for (auto& slot : m_readbacks[buffer.id].slots)
     {
-      GLBuffers.push_back(it->second);
+      if (slot.hostPtr != nullptr)
+        cl_transferQueue.enqueueUnmapMemObject(slot.pinned, slot.hostPtr, nullptr, nullptr);
     }
+    m_readbacks.erase(buffer.id);
+    return false;
   }
 
-  cl_int err = (interaction == interOpCLGL::ACQUIRE) ? cl_queue.enqueueAcquireGLObjects(&GLBuffers) : cl_queue.enqueueReleaseGLObjects(&GLBuffers);
+  auto& readback = m_readbacks[buffer.id];
+  auto& slot = readback.slots[readback.next];
+  const auto& src = m_memoryObjects[buffer.id];
+  const auto& snapshot = m_memoryObjects[slot.snapshot.id];
+
+  if (!waitForTransfers())
+    return false;
+
+  memoryAccesses accesses { { src.buffer(), argAccess::READ }, { snapshot.buffer(), argAccess::WRITE } };
+  auto dependencies = getDependencies(accesses);
+
+  // Snapshot of this slot may still be read by the copy started two frames ago
+  if (slot.ready() != nullptr)
+    dependencies.push_back(slot.ready);
+
+  // Device to device, fast enough not to delay the next frame
+  cl::Event snapshotEvent;
+  cl_int err = cl_queue.enqueueCopyBuffer(src.buffer, snapshot.buffer, 0, 0, size, asWaitList(dependencies), &snapshotEvent);
   if (err != CL_SUCCESS)
   {
-    CL_ERROR(err, "Cannot interact with GL buffers");
+    CL_ERROR(err, "Cannot snapshot buffer " + src.name);
     return false;
   }
-  else
+
+  trackDependencies(accesses, snapshotEvent);
+
+  // Waited for from the transfer queue
+  if (isTransferQueue(cl_transferQueue))
+    cl_queue.flush();
+
+  // Simulation queue never waits for this one, it overlaps with the next frame
+  const std::vector<cl::Event> snapshotDone { snapshotEvent };
+  err = cl_transferQueue.enqueueReadBuffer(snapshot.buffer, CL_FALSE, 0, size, slot.hostPtr, &snapshotDone, &slot.ready);
+  if (err != CL_SUCCESS)
   {
-    std::string allNames;
-    std::for_each(GLBufferNames.cbegin(), GLBufferNames.cend(), [&](const std::string& name)
-        { return allNames += name + " "; });
-    LOG_DEBUG(interaction == interOpCLGL::ACQUIRE ? "GL buffers acquired {}" : "GL buffers released {}", allNames);
+    CL_ERROR(err, "Cannot read back buffer " + src.name);
+    slot.ready = cl::Event();
+    return false;
   }
 
-  // Must flush and finish queue to make sure GL buffers have been released
-  if (interaction == interOpCLGL::RELEASE)
-    finishTasks();
+  cl_transferQueue.flush();
+
+  slot.size = size;
+  readback.next = (readback.next + 1) % static_cast<uint32_t>(readback.slots.size());
 
   return true;
 }
 
-bool Physics::CL::Context::mapAndSendBufferToDevice(std::string bufferName, const void* bufferPtr, size_t bufferSize)
+const void* Physics::CL::Context::getReadback(BufferHandle buffer, size_t& size)
 {
-  if (!m_init || bufferPtr == nullptr)
-    return false;
+  std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+  size = 0;
+
+  const auto it = m_readbacks.find(buffer.id);
+  if (!m_init || it == m_readbacks.end())
+    return nullptr;
+
+  const auto& slot = it->second.slots[it->second.next];
+  if (slot.ready() == nullptr)
+    return nullptr;
 
-  auto it = m_buffersMap.find(bufferName);
-  if (it == m_buffersMap.end())
+  // Copied, the slot is only reused by the next startReadback
+  const cl::Event ready = slot.ready;
+  const size_t readySize = slot.size;
+  void* hostPtr = slot.hostPtr;
+
+  // Started a frame ago, most likely complete by now
+  lock.unlock();
+  cl_int err = ready.wait();
+  if (err != CL_SUCCESS)
   {
-    LOG_ERROR("error buffer not existing");
-    return false;
+    CL_ERROR(err, "Cannot wait for read back of buffer " + std::to_string(buffer.id));
+    return nullptr;
   }
 
-  cl_int err;
-  void* mappedMemory = cl_queue.enqueueMapBuffer(it->second, CL_TRUE, CL_MAP_WRITE, 0, bufferSize, nullptr, nullptr, &err);
-  if (err < 0)
+  size = readySize;
+  return hostPtr;
+}
+
+Physics::CL::Context::memoryAccesses Physics::CL::Context::getKernelAccesses(const kernelObject& kernelObj) const
+{
+  memoryAccesses accesses;
+  if (!m_isOutOfOrder)
+    return accesses;
+
+  for (const auto& arg : kernelObj.args)
+  {
+    if (arg.memory() != nullptr)
+      accesses.emplace_back(arg.memory(), arg.access);
+  }
+
+  return accesses;
+}
+
+std::vector<cl::Event> Physics::CL::Context::getDependencies(const memoryAccesses& accesses) const
+{
+  std::vector<cl::Event> dependencies;
+
+  for (const auto& [memory, access] : accesses)
+  {
+    const auto it = m_dependencies.find(memory);
+    if (it == m_dependencies.end())
+      continue;
+
+    // Read after write, write after write
+    if (it->second.lastWrite() != nullptr)
+      dependencies.push_back(it->second.lastWrite);
+
+    // Write after read
+    if (access != argAccess::READ)
+      dependencies.insert(dependencies.end(), it->second.readsSinceWrite.cbegin(), it->second.readsSinceWrite.cend());
+  }
+
+  return dependencies;
+}
+
+void Physics::CL::Context::trackDependencies(const memoryAccesses& accesses, const cl::Event& event)
+{
+  if (!m_isOutOfOrder || event() == nullptr)
+    return;
+
+  for (const auto& [memory, access] : accesses)
+  {
+    auto& memoryDeps = m_dependencies[memory];
+
+    if (access == argAccess::READ)
+    {
+      // Buffers only read for many commands in a row, no need to keep the completed ones around
+      if (memoryDeps.readsSinceWrite.size() >= 64)
+      {
+        auto& reads = memoryDeps.readsSinceWrite;
+        reads.erase(std::remove_if(reads.begin(), reads.end(), [](const cl::Event& read)
+                        { return read.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE; }),
+            reads.end());
+      }
+      memoryDeps.readsSinceWrite.push_back(event);
+    }
+    else
+    {
+      // Waited on all previous reads and the last write, they are not needed anymore
+      memoryDeps.lastWrite = event;
+      memoryDeps.readsSinceWrite.clear();
+    }
+  }
+}
+
+size_t Physics::CL::Context::getLocalSize(KernelHandle kernel, size_t numGlobalWorkItems)
+{
+  auto& kernelObj = m_kernels[kernel.id];
+
+  const auto it = kernelObj.localSizes.find(numGlobalWorkItems);
+  if (it != kernelObj.localSizes.end())
+    return it->second;
+
+  size_t localSize = 0;
+  const std::string key = kernelObj.name + "/" + std::to_string(numGlobalWorkItems);
+
+  std::string value;
+  if (m_tuningDatabase.find(key, value))
   {
-    CL_ERROR(err, "Cannot map buffer " + bufferName + " to host memory");
+    std::istringstream(value) >> localSize;
+  }
+  else if (m_specs.autotune)
+  {
+    // Driver choice until a launch outside of a recording can be tuned
+    if (!tuneLocalSize(kernelObj, numGlobalWorkItems, localSize))
+      return 0;
+
+    m_tuningDatabase.store(key, std::to_string(localSize));
+  }
+
+  kernelObj.localSizes[numGlobalWorkItems] = localSize;
+  return localSize;
+}
+
+bool Physics::CL::Context::tuneLocalSize(const kernelObject& kernelObj, size_t numGlobalWorkItems, size_t& bestLocalSize)
+{
+  constexpr int NUM_TUNING_RUNS = 5;
+
+  // Runs wait for the whole queue, a recorded frame must not be cut by them
+  if (isRecording())
     return false;
+
+  // Runs overwrite the kernel outputs, nothing else must be using them
+  finishTasks();
+
+  const size_t maxLocalSize = kernelObj.kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(cl_device);
+  const size_t localSizeMultiple = kernelObj.kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(cl_device);
+
+  // Driver choice is a candidate too, global size must be a multiple of the local size before OpenCL 2.0
+  std::vector<size_t> candidates { 0 };
+  for (size_t localSize = std::max<size_t>(localSizeMultiple, 1); localSize <= maxLocalSize; localSize *= 2)
+  {
+    if (numGlobalWorkItems % localSize == 0)
+      candidates.push_back(localSize);
   }
-  memcpy(mappedMemory, bufferPtr, bufferSize);
-  err = cl_queue.enqueueUnmapMemObject(it->second, mappedMemory);
-  if (err < 0)
+
+  // Every run must start from the same data, otherwise a kernel accumulating into a buffer would diverge
+  // Backups are charged to the memory budget while tuning
+  std::vector<std::pair<cl::Buffer, cl::Buffer>> savedBuffers;
+  size_t savedBytes = 0;
+  for (const auto& arg : kernelObj.args)
+  {
+    if (arg.memory() == nullptr || arg.access == argAccess::READ || arg.memory.getInfo<CL_MEM_TYPE>() != CL_MEM_OBJECT_BUFFER)
+      continue;
+
+    if (std::any_of(savedBuffers.cbegin(), savedBuffers.cend(), [&](const auto& saved)
+            { return saved.first() == arg.memory(); }))
+      continue;
+
+    cl::Buffer buffer(arg.memory(), true);
+    const size_t size = buffer.getInfo<CL_MEM_SIZE>();
+    if (!reserveMemory(kernelObj.name + " tuning backup", "Context", size))
+    {
+      m_allocatedMemory -= savedBytes;
+      return false;
+    }
+    savedBytes += size;
+
+    cl::Buffer backup(cl_context, CL_MEM_READ_WRITE, size);
+    cl_queue.enqueueCopyBuffer(buffer, backup, 0, 0, size);
+    savedBuffers.emplace_back(buffer, backup);
+  }
+
+  const auto restoreBuffers = [&]()
+  {
+    for (const auto& [buffer, backup] : savedBuffers)
+      cl_queue.enqueueCopyBuffer(backup, buffer, 0, 0, buffer.getInfo<CL_MEM_SIZE>());
+    cl_queue.finish();
+  };
+
+  bestLocalSize = 0;
+  double bestMs = std::numeric_limits<double>::max();
+
+  for (const auto candidate : candidates)
+  {
+    double totalMs = 0.0;
+
+    try
+    {
+      for (int run = 0; run < NUM_TUNING_RUNS; ++run)
+      {
+        restoreBuffers();
+
+        cl::Event event;
+        cl_queue.enqueueNDRangeKernel(kernelObj.kernel, cl::NullRange, cl::NDRange(numGlobalWorkItems),
+            (candidate > 0) ? cl::NDRange(candidate) : cl::NullRange, nullptr, &event);
+        event.wait();
+
+        totalMs += static_cast<double>(event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>()) * 1e-6;
+      }
+    }
+    catch (const cl::Error& error)
+    {
+      // Too many resources for this local size, simply not a candidate
+      LOG_DEBUG("Local size {} rejected for kernel {} : {}", candidate, kernelObj.name, ErrorCodeToStr(error.err()));
+      continue;
+    }
+
+    if (totalMs < bestMs)
+    {
+      bestMs = totalMs;
+      bestLocalSize = candidate;
+    }
+  }
+
+  restoreBuffers();
+  savedBuffers.clear();
+  m_allocatedMemory -= savedBytes;
+
+  LOG_INFO("Tuned kernel {} for {} work items: local size {} ({} ms)", kernelObj.name, numGlobalWorkItems,
+      (bestLocalSize > 0) ? std::to_string(bestLocalSize) : "driver choice", bestMs / NUM_TUNING_RUNS);
+  return true;
+}
+
+bool Physics::CL::Context::findTuning(const std::string& key, std::string& value) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+  return m_tuningDatabase.find(key, value);
+}
+
+bool Physics::CL::Context::storeTuning(const std::string& key, const std::string& value)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+  return m_tuningDatabase.store(key, value);
+}
+
+std::vector<Physics::CL::kernelStats> Physics::CL::Context::getKernelStats() const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+  return m_profiler.getStats();
+}
+
+Physics::CL::kernelArgStats Physics::CL::Context::getKernelArgStats() const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+  return m_lastFrameArgStats;
+}
+
+bool Physics::CL::Context::isRecorded(CommandListHandle list) const
+{
+  std::lock_guard<std::recursive_mutex> lock(m_mutex);
+  return isValid(list) && m_commandLists[list.id].isRecorded;
+}
+
+size_t Physics::CL::Context::getMaxWorkGroupSize() const
+{
+  return cl_device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+}
+
+size_t Physics::CL::Context::getLocalMemSize() const
+{
+  return cl_device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+}
+
+std::vector<cl::Event> Physics::CL::Context::getTransferDependencies(const cl::CommandQueue& queue, const memoryAccesses& accesses)
+{
+  // Same in-order queue, nothing to wait for
+  if (!isTransferQueue(queue) && !m_isOutOfOrder)
+    return {};
+
+  std::vector<cl::Event> dependencies;
+
+  if (m_isOutOfOrder)
+  {
+    dependencies = getDependencies(accesses);
+  }
+  else
+  {
+    // No per buffer tracking on an in-order queue, waiting for everything enqueued so far
+    cl::Event marker;
+    cl_int err = cl_queue.enqueueMarkerWithWaitList(nullptr, &marker);
+    if (err != CL_SUCCESS)
+      CL_ERROR(err, "Cannot enqueue marker on simulation queue");
+    else
+      dependencies.push_back(marker);
+  }
+
+  // Events waited for from another queue must have been submitted to the device
+  if (isTransferQueue(queue) && !dependencies.empty())
+    cl_queue.flush();
+
+  return dependencies;
+}
+
+void Physics::CL::Context::trackTransfer(cl::CommandQueue& queue, const memoryAccesses& accesses, const cl::Event& event)
+{
+  if (m_isOutOfOrder)
+    trackDependencies(accesses, event);
+
+  if (!isTransferQueue(queue))
+    return;
+
+  if (!m_isOutOfOrder)
+    m_pendingTransfers.push_back(event);
+
+  // Simulation queue may wait for it
+  queue.flush();
+}
+
+bool Physics::CL::Context::waitForTransfers()
+{
+  // Out-of-order queue already waits for the transfers using the same buffers
+  if (m_pendingTransfers.empty())
+    return true;
+
+  cl_int err = cl_queue.enqueueBarrierWithWaitList(&m_pendingTransfers);
+  if (err != CL_SUCCESS)
   {
-    CL_ERROR(err, "Cannot unmap buffer" + bufferName);
+    CL_ERROR(err, "Cannot wait for transfers on simulation queue");
     return false;
   }
 
+  m_pendingTransfers.clear();
   return true;
 }
 
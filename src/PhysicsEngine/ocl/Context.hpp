@@ -1,9 +1,19 @@
 #pragma once
 
 #include "opencl.hpp"
+#include "Handles.hpp"
+#include "MemoryStats.hpp"
+#include "Profiler.hpp"
+#include "ProgramCache.hpp"
+#include "TuningDatabase.hpp"
 
+#include <array>
+#include <future>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace Physics
@@ -18,81 +28,435 @@ struct imageSpecs
   size_t height;
 };
 
+struct contextSpecs
+{
+  // No OpenGL context available: CL-GL sharing is skipped and any device type (GPU, accelerator or CPU) can be picked
+  bool headless = false;
+  // Share buffers with OpenGL if a device allows it, otherwise any device is picked and buffers to render are read back
+  bool GLInterop = true;
+  // Only devices whose name contains it are picked, empty for any device
+  std::string deviceName;
+  // Where built program binaries are kept between runs, empty to always build from source
+  std::string programCacheDir = "./kernelCache";
+  // Launches not sharing any written buffer may overlap, ordering is derived from the buffers each launch uses
+  bool outOfOrderQueue = false;
+  // Host transfers go through their own queue so they can overlap with simulation kernels
+  bool separateTransferQueue = true;
+  // Buffers and images over it are refused at creation, 0 for the whole device global memory
+  size_t memoryBudget = 0;
+  // Where autotuning results are kept between runs, empty to never persist them
+  std::string tuningDir = "./kernelCache";
+  // Benchmark local sizes of kernels launched without one, the first time they run with a given global size
+  bool autotune = false;
+};
+
+// How a kernel uses a buffer arg, only used to order launches on an out-of-order queue
+enum class argAccess
+{
+  READ_WRITE,
+  READ,
+  WRITE
+};
+
+// Thread safety: every call locks the context, so registries, dependency tracking and queue submissions stay
+// consistent when helper threads (export, meshing, telemetry) use the same context as the simulation loop.
+// Blocking calls (unload, map, read back) only wait for the device once unlocked.
+// Kernel args are the only state not safe to share: a kernel handle must be used by a single thread at a time,
+// helper threads work with their own clone of it. Commands of a thread are only recorded in the list it is recording.
 class Context
 {
   public:
-  static Context& Get();
+  // Each model owns its context, with its own device, queues, programs, kernels and buffers.
+  // Program binaries built by one context are reused by any other one on the same device
+  explicit Context(const contextSpecs& specs = {});
+  ~Context();
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+  Context(Context&&) = delete;
+  Context& operator=(Context&&) = delete;
 
   // Check if the context has been instantiated
   bool isInit() const { return m_init; }
+  // Check if the context has been created without any GL sharing
+  bool isHeadless() const { return m_specs.headless; }
+  // False if headless, or if no device could share buffers with the GL context
+  bool isGLInteropEnabled() const { return m_isGLInteropEnabled; }
   // Release every programs and kernels/buffers/datas on GPU side
   bool release();
 
   // Send all the tasks to device queue and wait for them to be complete
   bool finishTasks();
 
+  // Tuning results shared with modules tuning their own parameters, e.g. radix sort groups
+  bool isAutotuning() const { return m_specs.autotune; }
+  bool findTuning(const std::string& key, std::string& value) const;
+  bool storeTuning(const std::string& key, const std::string& value);
+  size_t getMaxWorkGroupSize() const;
+  size_t getLocalMemSize() const;
+
+  // Device may not support it, in which case the queue stays in order
+  bool isOutOfOrder() const { return m_isOutOfOrder; }
+
+  // Device and host share the same memory (CPU, integrated GPU), buffers are then allocated in host memory
+  // and mapping them gives access in place
+  bool isHostUnifiedMemory() const { return m_isHostUnifiedMemory; }
+
   bool isProfiling() const { return m_isKernelProfilingEnabled; }
-  void enableProfiler(bool enable) { m_isKernelProfilingEnabled = enable; }
-
-  bool createProgram(std::string name, std::vector<std::string> sourceNames, std::string specificBuildOptions);
-  bool createProgram(std::string name, std::string sourceName, std::string specificBuildOptions) { return createProgram(name, std::vector<std::string>({ sourceName }), specificBuildOptions); }
-  bool createGLBuffer(std::string name, unsigned int VBOIndex, cl_mem_flags memoryFlags);
-  bool createBuffer(std::string name, size_t bufferSize, cl_mem_flags memoryFlags);
-  bool createImage2D(std::string name, imageSpecs specs, cl_mem_flags memoryFlags);
-  bool loadBufferFromHost(std::string name, size_t offset, size_t sizeToFill, const void* hostPtr);
-  bool unloadBufferFromDevice(std::string name, size_t offset, size_t sizeToFill, void* hostPtr);
-  bool swapBuffers(std::string bufferNameA, std::string bufferNameB);
-  bool copyBuffer(std::string srcBufferName, std::string dstBufferName);
-  bool createKernel(std::string programName, std::string kernelName, std::vector<std::string> argNames);
-  bool setKernelArg(std::string kernelName, cl_uint argIndex, size_t argSize, const void* value);
-  bool setKernelArg(std::string kernelName, cl_uint argIndex, const std::string& bufferName);
-  bool runKernel(std::string kernelName, size_t numFlobalWorkItems, size_t numLocalWorkItems = 0);
-
-  bool acquireGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(GLBufferNames, interOpCLGL::ACQUIRE); }
-  bool releaseGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(GLBufferNames, interOpCLGL::RELEASE); }
-
-  bool mapAndSendBufferToDevice(std::string bufferName, const void* bufferPtr, size_t bufferSize);
+  void enableProfiler(bool enable);
+  // Mark the end of a simulation frame, profiling events of completed frames are resolved without blocking
+  // and kernel arg stats start over
+  void endProfilingFrame();
+  std::vector<kernelStats> getKernelStats() const;
+  // Over the last completed frame, counted even without profiling
+  kernelArgStats getKernelArgStats() const;
+
+  // Every buffer, GL buffer and image created so far, with their owner and the device memory budget
+  memoryReport getMemoryReport() const;
+
+  // Build runs on a worker thread so that several programs can be built concurrently, createKernel waits for it.
+  // Invalid future if the context is not initialized, a failed build rethrows when waited for.
+  std::shared_future<bool> createProgram(std::string name, std::vector<std::string> sourceNames, std::string specificBuildOptions);
+  std::shared_future<bool> createProgram(std::string name, std::string sourceName, std::string specificBuildOptions) { return createProgram(name, std::vector<std::string>({ sourceName }), specificBuildOptions); }
+  // Create a program from an intermediate language module (SPIR-V) with its compile-time constants already baked in,
+  // only if the device supports cl_khr_il_program
+  bool createProgramFromIL(const std::string& name, const std::vector<char>& IL);
+  bool isILSupported() const { return m_isILSupported; }
+
+  // Registries are flat vectors, returned handles index them directly
+  // Owner is the module creating the memory object, only used for memory reports
+  BufferHandle createGLBuffer(const std::string& name, unsigned int VBOIndex, cl_mem_flags memoryFlags, const std::string& owner = "");
+  BufferHandle createBuffer(const std::string& name, size_t bufferSize, cl_mem_flags memoryFlags, const std::string& owner = "");
+  BufferHandle createImage2D(const std::string& name, imageSpecs specs, cl_mem_flags memoryFlags, const std::string& owner = "");
+  // Carved from a single device allocation by allocateArena(), buffers of the same non-empty alias group share their memory:
+  // their lifetimes within a frame must not overlap
+  BufferHandle createArenaBuffer(const std::string& name, size_t bufferSize, const std::string& owner, const std::string& aliasGroup = "");
+  // Arena buffers can only be bound to kernels once allocated, no arena buffer can be created afterwards
+  bool allocateArena(cl_mem_flags memoryFlags = CL_MEM_READ_WRITE);
+  // An instance name registers the kernel under it instead of its kernel name, to create the same kernel from program variants
+  KernelHandle createKernel(const std::string& programName, const std::string& kernelName, const std::vector<std::string>& argNames, const std::string& instanceName = "");
+  // Own instance of the kernel with the args currently set, for another thread. Not reachable by name
+  KernelHandle cloneKernel(KernelHandle kernel);
+
+  // Name to handle lookup, invalid handle if not existing
+  BufferHandle findBuffer(const std::string& name) const;
+  KernelHandle findKernel(const std::string& name) const;
+
+  // 0 if not existing
+  size_t getBufferSize(BufferHandle buffer) const;
+  // Plain buffer not sharing its memory, which swapBuffers accepts
+  bool isSwappable(BufferHandle buffer) const;
+
+  bool loadBufferFromHost(BufferHandle buffer, size_t offset, size_t sizeToFill, const void* hostPtr);
+  bool unloadBufferFromDevice(BufferHandle buffer, size_t offset, size_t sizeToFill, void* hostPtr);
+  // Kernel args bound to either buffer are rebound, kernels keep using the memory behind the same handle
+  bool swapBuffers(BufferHandle bufferA, BufferHandle bufferB);
+  // Copies the first sizeToCopy bytes, 0 to copy as much as the destination buffer holds
+  bool copyBuffer(BufferHandle srcBuffer, BufferHandle dstBuffer, size_t sizeToCopy = 0);
+  bool setKernelArg(KernelHandle kernel, cl_uint argIndex, size_t argSize, const void* value);
+  bool setKernelArg(KernelHandle kernel, cl_uint argIndex, BufferHandle buffer);
+  // Buffer args are read only if declared const __global in the kernel, read-write otherwise, unless overridden here
+  bool setKernelArgAccess(KernelHandle kernel, cl_uint argIndex, argAccess access);
+  // Without local size, the tuned one is used if any, driver choice otherwise
+  bool runKernel(KernelHandle kernel, size_t numGlobalWorkItems, size_t numLocalWorkItems = 0);
+
+  // With cl_khr_gl_event, acquire and release synchronize with GL on the device, no queue drain on release
+  bool isGLEventSupported() const { return m_isGLEventSupported; }
+  // GL fence signaled once GL is done with the shared buffers, next acquire waits for it on the device
+  bool setGLFence(cl_GLsync fence);
+  bool acquireGLBuffers(const std::vector<BufferHandle>& GLBuffers) { return interactWithGLBuffers(GLBuffers, interOpCLGL::ACQUIRE); }
+  bool releaseGLBuffers(const std::vector<BufferHandle>& GLBuffers) { return interactWithGLBuffers(GLBuffers, interOpCLGL::RELEASE); }
+
+  bool mapAndSendBufferToDevice(BufferHandle buffer, const void* bufferPtr, size_t bufferSize);
+
+  // Host view of a buffer region, without any copy on host unified memory devices. Written views are sent back on unmap.
+  // Only one view per buffer, commands using the buffer must not be enqueued before it is unmapped.
+  // GL buffers must be acquired first
+  void* mapBuffer(BufferHandle buffer, size_t offset, size_t size, argAccess access);
+  bool unmapBuffer(BufferHandle buffer);
+
+  // Device to host copy through pinned memory, double buffered so that it overlaps with the next frame:
+  // the buffer is snapshotted on the device, the snapshot is then read on the transfer queue
+  bool startReadback(BufferHandle buffer, size_t size);
+  // Host copy started by the startReadback before the last one, so one frame late, null if none yet.
+  // Valid until the next startReadback of the buffer
+  const void* getReadback(BufferHandle buffer, size_t& size);
+
+  // Command lists record a sequence of launches, copies, swaps and GL interactions once, each launch with its own
+  // kernel instance and args bound at record time. Replaying it only enqueues, no arg is set again.
+  // Commands are still executed while recording. A list must be recorded again as soon as a kernel arg
+  // or launch size it relies on changes.
+  CommandListHandle createCommandList(const std::string& name);
+  bool beginRecording(CommandListHandle list);
+  bool endRecording();
+  bool isRecorded(CommandListHandle list) const;
+  void invalidateCommandList(CommandListHandle list);
+  bool replayCommandList(CommandListHandle list);
+
+  // Compatibility layer, names are resolved to handles on each call
+  bool loadBufferFromHost(const std::string& name, size_t offset, size_t sizeToFill, const void* hostPtr) { return loadBufferFromHost(findBuffer(name), offset, sizeToFill, hostPtr); }
+  bool unloadBufferFromDevice(const std::string& name, size_t offset, size_t sizeToFill, void* hostPtr) { return unloadBufferFromDevice(findBuffer(name), offset, sizeToFill, hostPtr); }
+  bool swapBuffers(const std::string& bufferNameA, const std::string& bufferNameB) { return swapBuffers(findBuffer(bufferNameA), findBuffer(bufferNameB)); }
+  bool copyBuffer(const std::string& srcBufferName, const std::string& dstBufferName) { return copyBuffer(findBuffer(srcBufferName), findBuffer(dstBufferName)); }
+  bool setKernelArg(const std::string& kernelName, cl_uint argIndex, size_t argSize, const void* value) { return setKernelArg(findKernel(kernelName), argIndex, argSize, value); }
+  bool setKernelArg(const std::string& kernelName, cl_uint argIndex, const std::string& bufferName) { return setKernelArg(findKernel(kernelName), argIndex, findBuffer(bufferName)); }
+  bool runKernel(const std::string& kernelName, size_t numGlobalWorkItems, size_t numLocalWorkItems = 0) { return runKernel(findKernel(kernelName), numGlobalWorkItems, numLocalWorkItems); }
+  bool acquireGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(findBuffers(GLBufferNames), interOpCLGL::ACQUIRE); }
+  bool releaseGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(findBuffers(GLBufferNames), interOpCLGL::RELEASE); }
+  bool mapAndSendBufferToDevice(const std::string& bufferName, const void* bufferPtr, size_t bufferSize) { return mapAndSendBufferToDevice(findBuffer(bufferName), bufferPtr, bufferSize); }
 
   std::string getPlatformName() const;
   std::string getDeviceName() const;
 
   private:
-  Context();
-  ~Context() = default;
-  Context(const Context&) = delete;
-  Context& operator=(const Context&) = delete;
-  Context(Context&&) = delete;
-  Context& operator=(const Context&&) = delete;
-
   bool findPlatforms();
   bool findGPUDevices();
+  bool findAllDevices();
   bool createContext();
   bool createCommandQueue();
 
+  // Offline compiled module of the program, only if built with the exact same compile-time constants
+  bool findProgramIL(const std::string& name, const std::string& specificBuildOptions, std::vector<char>& IL) const;
+
+  // Run on worker threads, they must not touch the registries
+  bool buildProgram(const std::string& name, const std::vector<std::string>& sourceNames, const std::string& specificBuildOptions, cl::Program& program) const;
+  bool buildProgramFromIL(const std::string& name, const std::vector<char>& IL, cl::Program& program) const;
+  bool waitForProgram(const std::string& name, cl::Program& program);
+
   enum class interOpCLGL
   {
     ACQUIRE,
     RELEASE
   };
-  bool interactWithGLBuffers(const std::vector<std::string>& GLBufferNames, interOpCLGL interaction);
+  bool interactWithGLBuffers(const std::vector<BufferHandle>& GLBuffers, interOpCLGL interaction);
+  // Kernel args bound to either buffer are given the memory now behind their handle, called right after a swap
+  void rebindSwappedArgs(BufferHandle bufferA, BufferHandle bufferB);
+  void addBufferArg(BufferHandle buffer, KernelHandle kernel, cl_uint argIndex);
+
+  enum class memoryKind
+  {
+    BUFFER,
+    BUFFER_GL,
+    IMAGE_2D
+  };
+
+  struct memoryObject
+  {
+    std::string name;
+    memoryKind kind;
+    // GL buffers are stored as their base buffer class, images are kept apart
+    cl::Buffer buffer;
+    cl::Image2D image;
+    // Sharing its memory with other buffers, cannot be swapped
+    bool isAliased = false;
+    // Host view given by mapBuffer, null if not mapped
+    void* mappedPtr = nullptr;
+    argAccess mappedAccess = argAccess::READ_WRITE;
+    std::string owner;
+    size_t size = 0;
+    cl_mem_flags flags = 0;
+
+    const cl::Memory& memory() const { return (kind == memoryKind::IMAGE_2D) ? static_cast<const cl::Memory&>(image) : buffer; }
+  };
+
+  // Last value given to a kernel arg, needed to bind recorded launches and to skip identical bindings
+  struct kernelArg
+  {
+    size_t size = 0;
+    // Empty for buffers and local memory
+    std::vector<unsigned char> value;
+    cl::Memory memory;
+    argAccess access = argAccess::READ_WRITE;
+  };
+
+  using memoryAccesses = std::vector<std::pair<cl_mem, argAccess>>;
+
+  // Pending commands using a memory object, only tracked on an out-of-order queue
+  struct memoryDependencies
+  {
+    cl::Event lastWrite;
+    std::vector<cl::Event> readsSinceWrite;
+  };
+
+  struct kernelObject
+  {
+    std::string name;
+    cl::Kernel kernel;
+    std::vector<kernelArg> args;
+    // Per global size, 0 for driver choice
+    std::unordered_map<size_t, size_t> localSizes;
+  };
+
+  enum class commandType
+  {
+    KERNEL,
+    COPY,
+    SWAP,
+    ACQUIRE_GL,
+    RELEASE_GL
+  };
+
+  struct recordedCommand
+  {
+    commandType type;
+    // KERNEL : private instance of the kernel with all its args set
+    KernelHandle kernel;
+    cl::Kernel boundKernel;
+    cl::NDRange global;
+    cl::NDRange local;
+    // COPY
+    cl::Buffer src;
+    cl::Buffer dst;
+    size_t size = 0;
+    // SWAP, replayed on host so that handles keep pointing to the same buffers as without recording
+    BufferHandle bufferA;
+    BufferHandle bufferB;
+    // ACQUIRE_GL, RELEASE_GL
+    std::vector<cl::Memory> GLObjects;
+    // Memory objects used, to order the command on an out-of-order queue
+    memoryAccesses accesses;
+  };
+
+  struct commandList
+  {
+    std::string name;
+    std::vector<recordedCommand> commands;
+    bool isRecorded = false;
+  };
+
+  void recordKernel(KernelHandle kernel, const cl::NDRange& global, const cl::NDRange& local);
+  // New instance of the kernel with the same args, so that it is not affected by later arg changes
+  cl::Kernel instantiateKernel(const kernelObject& kernelObj, cl_int& err) const;
+  // Only commands of the thread recording are part of the list
+  bool isRecording() const { return m_recordingList.isValid() && m_recordingThread == std::this_thread::get_id(); }
+  size_t getLocalSize(KernelHandle kernel, size_t numGlobalWorkItems);
+  // Fastest local size over a few runs, buffers written by the kernel are restored after each run.
+  // False if not tuned: while recording, or if the backups of these buffers do not fit in the memory budget
+  bool tuneLocalSize(const kernelObject& kernelObj, size_t numGlobalWorkItems, size_t& bestLocalSize);
+  bool enqueueGLInteraction(const std::vector<cl::Memory>& GLObjects, interOpCLGL interaction);
+
+  memoryAccesses getKernelAccesses(const kernelObject& kernelObj) const;
+  // Events the command must wait for, only filled on an out-of-order queue
+  std::vector<cl::Event> getDependencies(const memoryAccesses& accesses) const;
+  void trackDependencies(const memoryAccesses& accesses, const cl::Event& event);
+  // Null wait list if there is nothing to wait for, as expected by enqueue functions
+  static const std::vector<cl::Event>* asWaitList(const std::vector<cl::Event>& events) { return events.empty() ? nullptr : &events; }
+
+  // GL shared buffers stay on the queue they are acquired on
+  cl::CommandQueue& getTransferQueue(memoryKind kind) { return (kind == memoryKind::BUFFER_GL) ? cl_queue : cl_transferQueue; }
+  bool isTransferQueue(const cl::CommandQueue& queue) const { return queue() != cl_queue(); }
+  // Events a host transfer must wait for on the given queue
+  std::vector<cl::Event> getTransferDependencies(const cl::CommandQueue& queue, const memoryAccesses& accesses);
+  void trackTransfer(cl::CommandQueue& queue, const memoryAccesses& accesses, const cl::Event& event);
+  // Simulation commands enqueued next must see data sent on the transfer queue
+  bool waitForTransfers();
+
+  BufferHandle registerMemoryObject(const std::string& name, memoryKind kind, const cl::Buffer& buffer, const cl::Image2D& image, size_t size, cl_mem_flags flags, const std::string& owner);
+  // Snapshot buffers and pinned memory mapped for the whole context lifetime
+  bool createReadback(BufferHandle buffer, size_t size);
+  // Buffers are allocated in host memory on host unified memory devices, unless placed explicitly
+  cl_mem_flags getAllocationFlags(cl_mem_flags memoryFlags) const;
+  // Account for a new allocation, false if it does not fit in the memory budget
+  bool reserveMemory(const std::string& name, const std::string& owner, size_t size);
+  std::vector<BufferHandle> findBuffers(const std::vector<std::string>& names) const;
+  bool isValid(BufferHandle buffer) const { return buffer.id < m_memoryObjects.size(); }
+  bool isValid(KernelHandle kernel) const { return kernel.id < m_kernels.size(); }
+  bool isValid(CommandListHandle list) const { return list.id < m_commandLists.size(); }
 
   cl::Platform cl_platform;
   cl::Device cl_device;
   cl::Context cl_context;
   cl::CommandQueue cl_queue;
+  // Same as cl_queue if no separate transfer queue is used
+  cl::CommandQueue cl_transferQueue;
 
-  std::map<std::string, cl::Program> m_programsMap;
-  std::map<std::string, cl::Kernel> m_kernelsMap;
-  std::map<std::string, cl::Buffer> m_buffersMap;
-  std::map<std::string, cl::BufferGL> m_GLBuffersMap;
-  std::map<std::string, cl::Image2D> m_imagesMap;
+  struct programObject
+  {
+    std::shared_future<bool> build;
+    cl::Program program;
+  };
+
+  std::map<std::string, programObject> m_programsMap;
+  ProgramCache m_programCache;
+  TuningDatabase m_tuningDatabase;
+
+  // Buffers placed at the same offset of the arena
+  struct arenaSlot
+  {
+    std::string aliasGroup;
+    size_t size;
+    // Sum of the aliased buffer sizes, what they would take if allocated apart
+    size_t requestedSize;
+    std::vector<uint32_t> memoryObjectIds;
+  };
+
+  std::vector<arenaSlot> m_arenaSlots;
+  cl::Buffer m_arena;
+
+  struct readbackSlot
+  {
+    // Device copy taken right after the frame, later frames can overwrite the buffer while it is read
+    BufferHandle snapshot;
+    // CL_MEM_ALLOC_HOST_PTR, mapped once, reads into it run at full transfer speed
+    cl::Buffer pinned;
+    void* hostPtr = nullptr;
+    // Read of the snapshot into pinned memory
+    cl::Event ready;
+    size_t size = 0;
+  };
 
+  struct readbackObject
+  {
+    std::array<readbackSlot, 2> slots;
+    // Slot written by the next startReadback, it holds the copy started before the latest one
+    uint32_t next = 0;
+  };
+
+  // Per buffer id
+  std::unordered_map<uint32_t, readbackObject> m_readbacks;
+
+  size_t m_memoryBudget;
+  size_t m_allocatedMemory;
+  size_t m_peakAllocatedMemory;
+
+  std::vector<kernelObject> m_kernels;
+  std::vector<memoryObject> m_memoryObjects;
+  std::unordered_map<std::string, uint32_t> m_kernelIds;
+  std::unordered_map<std::string, uint32_t> m_memoryObjectIds;
+  // Per buffer id, kernel args bound to it by name or handle, so that a swap only rebinds those.
+  // Entries overwritten since are dropped at the next swap
+  std::unordered_map<uint32_t, std::vector<std::pair<KernelHandle, cl_uint>>> m_bufferArgs;
+
+  std::vector<commandList> m_commandLists;
+  // List being recorded, invalid handle if none
+  CommandListHandle m_recordingList;
+  std::thread::id m_recordingThread;
+  // Buffers behind each handle when recording started, replay is only valid if they are the same at the end
+  std::vector<cl_mem> m_recordingBuffers;
+
+  contextSpecs m_specs;
+
+  bool m_isILSupported;
+  bool m_isOutOfOrder;
+  bool m_isGLInteropEnabled;
+  bool m_isHostUnifiedMemory;
+  bool m_isGLEventSupported;
+  // From the last GL fence, waited for by the next acquire
+  cl::Event m_GLFenceEvent;
+  std::unordered_map<cl_mem, memoryDependencies> m_dependencies;
+  // Uploads not waited for yet by the in-order simulation queue
+  std::vector<cl::Event> m_pendingTransfers;
   bool m_isKernelProfilingEnabled;
+  Profiler m_profiler;
+  kernelArgStats m_frameArgStats;
+  kernelArgStats m_lastFrameArgStats;
 
   bool m_init;
 
+  // Recursive, calls are made from within other calls
+  mutable std::recursive_mutex m_mutex;
+
   std::vector<cl::Platform> m_allPlatforms;
-  std::vector<std::pair<cl::Platform, std::vector<cl::Device>>> m_allGPUsWithInteropCLGL;
+  std::vector<std::pair<cl::Platform, std::vector<cl::Device>>> m_allCandidateDevices;
 };
 } //CL
 } //Core
\ No newline at end of file
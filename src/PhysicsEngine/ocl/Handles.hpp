@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Kept free of any OpenCL include so that it can be used from any header
+
+namespace Physics
+{
+namespace CL
+{
+// Small integer handle, index in the flat registries of the context
+template <typename Tag>
+struct Handle
+{
+  static constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+  uint32_t id = INVALID_ID;
+
+  bool isValid() const { return id != INVALID_ID; }
+  bool operator==(const Handle& other) const = default;
+};
+
+using KernelHandle = Handle<struct KernelTag>;
+// Used for buffers, GL buffers and images
+using BufferHandle = Handle<struct BufferTag>;
+using CommandListHandle = Handle<struct CommandListTag>;
+} //CL
+} //Physics
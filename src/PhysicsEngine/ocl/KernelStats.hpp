@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Physics
+{
+namespace CL
+{
+// Timings of a kernel aggregated over the profiler rolling window, in ms
+struct kernelStats
+{
+  std::string name;
+  double minMs = 0.0;
+  double meanMs = 0.0;
+  double maxMs = 0.0;
+  // Sum of all launches of the kernel in a frame, averaged over the window
+  double msPerFrame = 0.0;
+  size_t nbLaunches = 0;
+};
+
+// Kernel arg bindings of a frame, binding the value an arg already holds is skipped
+struct kernelArgStats
+{
+  // Actual clSetKernelArg calls
+  size_t nbSet = 0;
+  size_t nbElided = 0;
+};
+} //CL
+} //Physics
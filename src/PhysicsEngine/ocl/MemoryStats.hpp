@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Physics
+{
+namespace CL
+{
+// Device memory behind a buffer, GL buffer or image created through the context
+struct bufferMemory
+{
+  std::string name;
+  // Module which created it (PBF, RadixSort, Mesher...)
+  std::string owner;
+  // Buffer, GL buffer or image
+  std::string kind;
+  size_t bytes = 0;
+  // cl_mem_flags it has been created with
+  uint64_t flags = 0;
+  // Arena slot shared with other buffers, empty if not aliased
+  std::string aliasGroup;
+};
+
+struct memoryReport
+{
+  std::vector<bufferMemory> buffers;
+  // Device memory per owner, an aliased arena slot is counted once for the owner of its first buffer
+  std::vector<std::pair<std::string, size_t>> owners;
+  // Actually allocated, aliased buffers are only counted once
+  size_t totalBytes = 0;
+  size_t peakBytes = 0;
+  // CL_DEVICE_GLOBAL_MEM_SIZE
+  size_t deviceBytes = 0;
+  // Creations over it are refused
+  size_t budgetBytes = 0;
+
+  size_t headroomBytes() const { return (budgetBytes > totalBytes) ? budgetBytes - totalBytes : 0; }
+};
+} //CL
+} //Physics
@@ -0,0 +1,163 @@
+#include "Profiler.hpp"
+
+#include "ErrorCode.hpp"
+#include "Logger.h"
+
+#include <algorithm>
+#include <limits>
+
+Physics::CL::Profiler::Profiler(size_t windowSize, size_t maxPendingFrames)
+    : m_windowSize(std::max<size_t>(windowSize, 1))
+    , m_maxPendingFrames(std::max<size_t>(maxPendingFrames, 1))
+{
+}
+
+void Physics::CL::Profiler::record(KernelHandle kernel, const std::string& kernelName, const cl::Event& event)
+{
+  if (!kernel.isValid())
+    return;
+
+  if (kernel.id >= m_kernels.size())
+    m_kernels.resize(kernel.id + 1);
+
+  if (m_kernels[kernel.id].name.empty())
+    m_kernels[kernel.id].name = kernelName;
+
+  m_currFrame.push_back({ kernel, event });
+}
+
+void Physics::CL::Profiler::endFrame()
+{
+  m_pendingFrames.push_back(std::move(m_currFrame));
+  m_currFrame.clear();
+
+  // Frames are submitted in order, stop at the first one still running
+  while (!m_pendingFrames.empty() && isComplete(m_pendingFrames.front()))
+  {
+    resolve(m_pendingFrames.front());
+    m_pendingFrames.pop_front();
+  }
+
+  // Device is lagging too much behind, wait for the oldest frame to keep memory bounded
+  while (m_pendingFrames.size() > m_maxPendingFrames)
+  {
+    // Launches may complete in any order on an out-of-order queue, the last one is not enough
+    auto& oldestFrame = m_pendingFrames.front();
+    for (auto& launch : oldestFrame)
+      launch.event.wait();
+    resolve(oldestFrame);
+    m_pendingFrames.pop_front();
+  }
+}
+
+void Physics::CL::Profiler::flush()
+{
+  if (!m_currFrame.empty())
+  {
+    m_pendingFrames.push_back(std::move(m_currFrame));
+    m_currFrame.clear();
+  }
+
+  for (auto& frame : m_pendingFrames)
+  {
+    for (auto& launch : frame)
+      launch.event.wait();
+    resolve(frame);
+  }
+  m_pendingFrames.clear();
+}
+
+void Physics::CL::Profiler::reset()
+{
+  m_currFrame.clear();
+  m_pendingFrames.clear();
+  m_kernels.clear();
+}
+
+bool Physics::CL::Profiler::isComplete(const std::vector<launch>& frame) const
+{
+  try
+  {
+    for (const auto& launch : frame)
+    {
+      // Negative status means the command has been aborted, nothing more will happen to it
+      if (launch.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() > CL_COMPLETE)
+        return false;
+    }
+  }
+  catch (const cl::Error& error)
+  {
+    CL_ERROR(error.err(), "Cannot query profiling event status");
+  }
+  return true;
+}
+
+void Physics::CL::Profiler::resolve(const std::vector<launch>& frame)
+{
+  std::vector<frameSample> frameSamples(m_kernels.size());
+
+  for (const auto& launch : frame)
+  {
+    cl_ulong start = 0, end = 0;
+    try
+    {
+      launch.event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+      launch.event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+    }
+    catch (const cl::Error& error)
+    {
+      CL_ERROR(error.err(), "Cannot get profiling infos of kernel " + m_kernels[launch.kernel.id].name);
+      continue;
+    }
+
+    //the resolution of the events is 1e-09 sec
+    const double timeMs = (double)((cl_double)(end - start) * (1e-06));
+
+    auto& sample = frameSamples[launch.kernel.id];
+    sample.minMs = (sample.nbLaunches == 0) ? timeMs : std::min(sample.minMs, timeMs);
+    sample.maxMs = std::max(sample.maxMs, timeMs);
+    sample.totalMs += timeMs;
+    ++sample.nbLaunches;
+  }
+
+  for (size_t kernelId = 0; kernelId < m_kernels.size(); ++kernelId)
+  {
+    auto& samples = m_kernels[kernelId].samples;
+    samples.push_back(frameSamples[kernelId]);
+    if (samples.size() > m_windowSize)
+      samples.pop_front();
+  }
+}
+
+std::vector<Physics::CL::kernelStats> Physics::CL::Profiler::getStats() const
+{
+  std::vector<kernelStats> allStats;
+
+  for (const auto& kernel : m_kernels)
+  {
+    kernelStats stats;
+    stats.name = kernel.name;
+    stats.minMs = std::numeric_limits<double>::max();
+
+    double totalMs = 0.0;
+    for (const auto& sample : kernel.samples)
+    {
+      if (sample.nbLaunches == 0)
+        continue;
+
+      stats.minMs = std::min(stats.minMs, sample.minMs);
+      stats.maxMs = std::max(stats.maxMs, sample.maxMs);
+      stats.nbLaunches += sample.nbLaunches;
+      totalMs += sample.totalMs;
+    }
+
+    if (stats.nbLaunches == 0)
+      continue;
+
+    stats.meanMs = totalMs / stats.nbLaunches;
+    stats.msPerFrame = totalMs / kernel.samples.size();
+    allStats.push_back(stats);
+  }
+
+  return allStats;
+}
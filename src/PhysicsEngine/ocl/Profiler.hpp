@@ -0,0 +1,70 @@
+#pragma once
+
+#include "opencl.hpp"
+#include "Handles.hpp"
+#include "KernelStats.hpp"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace Physics
+{
+namespace CL
+{
+// Collects kernel events of each frame and resolves them once the device is done with them,
+// nothing here waits on the queue unless too many frames are pending
+class Profiler
+{
+  public:
+  Profiler(size_t windowSize = 120, size_t maxPendingFrames = 4);
+
+  void record(KernelHandle kernel, const std::string& kernelName, const cl::Event& event);
+
+  // Close current frame and resolve every completed pending frame
+  void endFrame();
+
+  // Wait for all pending frames and resolve them
+  void flush();
+
+  void reset();
+
+  std::vector<kernelStats> getStats() const;
+
+  private:
+  struct launch
+  {
+    KernelHandle kernel;
+    cl::Event event;
+  };
+
+  // Timings of a kernel in a single frame
+  struct frameSample
+  {
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    size_t nbLaunches = 0;
+  };
+
+  struct kernelHistory
+  {
+    std::string name;
+    // One sample per resolved frame, empty sample if kernel not launched
+    std::deque<frameSample> samples;
+  };
+
+  bool isComplete(const std::vector<launch>& frame) const;
+  void resolve(const std::vector<launch>& frame);
+
+  size_t m_windowSize;
+  size_t m_maxPendingFrames;
+
+  std::vector<launch> m_currFrame;
+  std::deque<std::vector<launch>> m_pendingFrames;
+
+  // Indexed by kernel handle id
+  std::vector<kernelHistory> m_kernels;
+};
+} //CL
+} //Physics
@@ -0,0 +1,205 @@
+#include "ProgramCache.hpp"
+
+#include "ErrorCode.hpp"
+#include "Logger.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+// Bump it if the layout of cache entries ever changes
+constexpr uint64_t CACHE_FORMAT_VERSION = 1;
+
+// FNV-1a, stable across runs and platforms unlike std::hash
+class Hasher
+{
+  public:
+  void add(const std::string& data)
+  {
+    for (const unsigned char c : data)
+    {
+      m_hash ^= c;
+      m_hash *= 0x100000001b3ULL;
+    }
+    // Separator so that ("ab", "c") and ("a", "bc") don't collide
+    m_hash ^= 0xff;
+    m_hash *= 0x100000001b3ULL;
+  }
+
+  uint64_t get() const { return m_hash; }
+
+  private:
+  uint64_t m_hash = 0xcbf29ce484222325ULL;
+};
+
+// Binaries built or loaded by any context of the process, contexts on the same device never build a program twice
+std::mutex s_binariesMutex;
+std::unordered_map<std::string, std::vector<unsigned char>> s_binaries;
+}
+
+Physics::CL::ProgramCache::ProgramCache(std::string directory)
+    : m_directory(std::move(directory))
+{
+}
+
+std::string Physics::CL::ProgramCache::computeKey(const cl::Device& device, const cl::Program::Sources& sources, const std::string& options) const
+{
+  Hasher hasher;
+  hasher.add(std::to_string(CACHE_FORMAT_VERSION));
+
+  // Binaries are only valid for the exact same device and driver
+  hasher.add(device.getInfo<CL_DEVICE_NAME>());
+  hasher.add(device.getInfo<CL_DEVICE_VENDOR>());
+  hasher.add(device.getInfo<CL_DEVICE_VERSION>());
+  hasher.add(device.getInfo<CL_DRIVER_VERSION>());
+
+  hasher.add(options);
+  for (const auto& source : sources)
+    hasher.add(source);
+
+  std::ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0') << hasher.get();
+  return key.str();
+}
+
+std::string Physics::CL::ProgramCache::ComputeDeviceKey(const cl::Device& device)
+{
+  Hasher hasher;
+  hasher.add(device.getInfo<CL_DEVICE_NAME>());
+  hasher.add(device.getInfo<CL_DEVICE_VENDOR>());
+  hasher.add(device.getInfo<CL_DEVICE_VERSION>());
+  hasher.add(device.getInfo<CL_DRIVER_VERSION>());
+
+  std::ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0') << hasher.get();
+  return key.str();
+}
+
+std::string Physics::CL::ProgramCache::getEntryPath(const std::string& key) const
+{
+  return (std::filesystem::path(m_directory) / (key + ".bin")).string();
+}
+
+bool Physics::CL::ProgramCache::findBinary(const std::string& key, std::vector<unsigned char>& binary) const
+{
+  {
+    std::lock_guard<std::mutex> lock(s_binariesMutex);
+    const auto it = s_binaries.find(key);
+    if (it != s_binaries.end())
+    {
+      binary = it->second;
+      return true;
+    }
+  }
+
+  if (!isEnabled())
+    return false;
+
+  std::ifstream entryFile(getEntryPath(key), std::ios::binary);
+  if (!entryFile.is_open())
+    return false;
+
+  binary.assign(std::istreambuf_iterator<char>(entryFile), std::istreambuf_iterator<char>());
+  if (binary.empty())
+    return false;
+
+  std::lock_guard<std::mutex> lock(s_binariesMutex);
+  s_binaries.emplace(key, binary);
+  return true;
+}
+
+bool Physics::CL::ProgramCache::load(const std::string& key, const cl::Context& context, const cl::Device& device, const std::string& options, cl::Program& program) const
+{
+  std::vector<unsigned char> binary;
+  if (!findBinary(key, binary))
+    return false;
+
+  try
+  {
+    std::vector<cl_int> binaryStatus;
+    cl_int err;
+    program = cl::Program(context, { device }, cl::Program::Binaries({ binary }), &binaryStatus, &err);
+    if (err != CL_SUCCESS || binaryStatus.front() != CL_SUCCESS)
+      return false;
+
+    // Still needed with a binary, the driver finalizes it for the device
+    err = program.build({ device }, options.c_str());
+    if (err != CL_SUCCESS)
+      return false;
+  }
+  catch (const cl::Error& error)
+  {
+    // Outdated or corrupted entry, the program will be built from source and the entry overwritten
+    LOG_INFO("Rejected program cache entry {} : {}", key, ErrorCodeToStr(error.err()));
+    std::lock_guard<std::mutex> lock(s_binariesMutex);
+    s_binaries.erase(key);
+    return false;
+  }
+
+  LOG_INFO("Loaded program binary {} from cache", key);
+  return true;
+}
+
+bool Physics::CL::ProgramCache::store(const std::string& key, const cl::Program& program) const
+{
+  std::vector<std::vector<unsigned char>> binaries;
+  try
+  {
+    binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+  }
+  catch (const cl::Error& error)
+  {
+    CL_ERROR(error.err(), "Cannot get program binaries");
+    return false;
+  }
+
+  if (binaries.empty() || binaries.front().empty())
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lock(s_binariesMutex);
+    s_binaries[key] = binaries.front();
+  }
+
+  if (!isEnabled())
+    return true;
+
+  std::error_code fsError;
+  std::filesystem::create_directories(m_directory, fsError);
+  if (fsError)
+  {
+    LOG_INFO("Cannot create program cache directory {} : {}", m_directory, fsError.message());
+    return false;
+  }
+
+  // Write then rename, a concurrent or interrupted run never sees a partial entry
+  const std::string entryPath = getEntryPath(key);
+  const std::string tmpPath = entryPath + ".tmp";
+  {
+    std::ofstream entryFile(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!entryFile.is_open())
+    {
+      LOG_INFO("Cannot write program cache entry {}", tmpPath);
+      return false;
+    }
+    const auto& binary = binaries.front();
+    entryFile.write(reinterpret_cast<const char*>(binary.data()), static_cast<std::streamsize>(binary.size()));
+  }
+
+  std::filesystem::rename(tmpPath, entryPath, fsError);
+  if (fsError)
+  {
+    LOG_INFO("Cannot write program cache entry {} : {}", entryPath, fsError.message());
+    std::filesystem::remove(tmpPath, fsError);
+    return false;
+  }
+
+  LOG_INFO("Stored program binary {} in cache", key);
+  return true;
+}
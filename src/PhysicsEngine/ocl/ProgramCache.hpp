@@ -0,0 +1,42 @@
+#pragma once
+
+#include "opencl.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Physics
+{
+namespace CL
+{
+// Persistent cache of built program binaries, one file per program in the cache directory.
+// Entries are keyed by a hash of the sources, build options and device/driver versions,
+// so any change of one of them simply misses the cache.
+// Binaries are also kept in memory for the whole process and shared by every context.
+class ProgramCache
+{
+  public:
+  // Empty directory disables the persistent cache, binaries are still shared within the process
+  explicit ProgramCache(std::string directory = "");
+
+  bool isEnabled() const { return !m_directory.empty(); }
+
+  std::string computeKey(const cl::Device& device, const cl::Program::Sources& sources, const std::string& options) const;
+  // Only depends on the device and its driver
+  static std::string ComputeDeviceKey(const cl::Device& device);
+
+  // Create and build the program from its cached binary, false if missing or rejected by the driver
+  bool load(const std::string& key, const cl::Context& context, const cl::Device& device, const std::string& options, cl::Program& program) const;
+
+  // Store the binary of an already built program
+  bool store(const std::string& key, const cl::Program& program) const;
+
+  private:
+  // In memory first, then on disk
+  bool findBinary(const std::string& key, std::vector<unsigned char>& binary) const;
+  std::string getEntryPath(const std::string& key) const;
+
+  std::string m_directory;
+};
+} //CL
+} //Physics
@@ -0,0 +1,115 @@
+#include "TuningDatabase.hpp"
+
+#include "ProgramCache.hpp"
+#include "Logger.h"
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+// Contexts of the same process may tune on the same device, and so write the same file
+std::mutex s_databaseMutex;
+}
+
+Physics::CL::TuningDatabase::TuningDatabase(std::string directory)
+    : m_directory(std::move(directory))
+{
+}
+
+void Physics::CL::TuningDatabase::open(const cl::Device& device)
+{
+  m_entries.clear();
+
+  if (!isEnabled())
+    return;
+
+  // Results of another device or driver version are meaningless, they live in another file
+  m_path = (std::filesystem::path(m_directory) / (ProgramCache::ComputeDeviceKey(device) + ".tuning")).string();
+
+  std::lock_guard<std::mutex> lock(s_databaseMutex);
+  if (readEntries(m_entries))
+    LOG_INFO("Loaded {} tuning entries from {}", m_entries.size(), m_path);
+}
+
+bool Physics::CL::TuningDatabase::readEntries(std::map<std::string, std::string>& entries) const
+{
+  std::ifstream databaseFile(m_path);
+  if (!databaseFile.is_open())
+    return false;
+
+  std::string line;
+  while (std::getline(databaseFile, line))
+  {
+    std::istringstream lineStream(line);
+    std::string key;
+    if (!(lineStream >> key))
+      continue;
+
+    std::string value;
+    std::getline(lineStream >> std::ws, value);
+    entries[key] = value;
+  }
+
+  return true;
+}
+
+bool Physics::CL::TuningDatabase::find(const std::string& key, std::string& value) const
+{
+  const auto it = m_entries.find(key);
+  if (it == m_entries.end())
+    return false;
+
+  value = it->second;
+  return true;
+}
+
+bool Physics::CL::TuningDatabase::store(const std::string& key, const std::string& value)
+{
+  m_entries[key] = value;
+
+  if (!isEnabled() || m_path.empty())
+    return false;
+
+  std::lock_guard<std::mutex> lock(s_databaseMutex);
+
+  // Another context may have stored entries since this one was opened, they are kept
+  std::map<std::string, std::string> fileEntries;
+  readEntries(fileEntries);
+  for (const auto& [fileKey, fileValue] : fileEntries)
+    m_entries.emplace(fileKey, fileValue);
+
+  std::error_code fsError;
+  std::filesystem::create_directories(m_directory, fsError);
+  if (fsError)
+  {
+    LOG_INFO("Cannot create tuning directory {} : {}", m_directory, fsError.message());
+    return false;
+  }
+
+  // Write then rename, a concurrent or interrupted run never sees a partial database
+  const std::string tmpPath = m_path + ".tmp";
+  {
+    std::ofstream databaseFile(tmpPath, std::ios::trunc);
+    if (!databaseFile.is_open())
+    {
+      LOG_INFO("Cannot write tuning database {}", tmpPath);
+      return false;
+    }
+
+    for (const auto& [entryKey, entryValue] : m_entries)
+      databaseFile << entryKey << " " << entryValue << "\n";
+  }
+
+  std::filesystem::rename(tmpPath, m_path, fsError);
+  if (fsError)
+  {
+    LOG_INFO("Cannot write tuning database {} : {}", m_path, fsError.message());
+    std::filesystem::remove(tmpPath, fsError);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "opencl.hpp"
+
+#include <map>
+#include <string>
+
+namespace Physics
+{
+namespace CL
+{
+// Persistent autotuning results, one text file per device and driver in the tuning directory.
+// Each line is a key without spaces followed by its value, e.g. "density/131072 128".
+class TuningDatabase
+{
+  public:
+  // Empty directory disables the database
+  explicit TuningDatabase(std::string directory = "");
+
+  bool isEnabled() const { return !m_directory.empty(); }
+
+  // Load the entries already tuned for this device
+  void open(const cl::Device& device);
+
+  bool find(const std::string& key, std::string& value) const;
+
+  // Whole file is rewritten, entries are only added while tuning. Entries stored meanwhile by other contexts are kept
+  bool store(const std::string& key, const std::string& value);
+
+  private:
+  // Adds the entries of the database file, false if there is none
+  bool readEntries(std::map<std::string, std::string>& entries) const;
+
+  std::string m_directory;
+  std::string m_path;
+  std::map<std::string, std::string> m_entries;
+};
+} //CL
+} //Physics
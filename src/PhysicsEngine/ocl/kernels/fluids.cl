@@ -3,21 +3,35 @@
 // Macklin and Muller 2013. "Position Based Fluids"
 
 // Preprocessor defines following constant variables in PositionBasedFluids.cpp
+// BOX_SIZE                - length of one side of the simulation box
+// GRID_RES                - resolution of the grid
+// NUM_MAX_PARTS_IN_CELL   - maximum number of particles taking into account in
+// a single cell in simplified mode
+
+// Derived from them, also used by grid.cl
 // EFFECT_RADIUS           - radius around a particle where boids laws apply
 // ABS_WALL_POS            - absolute position of the walls in x,y,z
-// GRID_RES                - resolution of the grid
+// GRID_CELL_SIZE          - size of a cell, size / res of grid
 // GRID_NUM_CELLS          - total number of cells in the grid
-// NUM_MAX_PARTS_IN_CELL   - maximum number of particles taking into account in
-// a single cell in simplified mode REST_DENSITY            - rest density of
-// the fluid POLY6_COEFF             - coefficient of the Poly6 kernel,
-// depending on EFFECT_RADIUS SPIKY_COEFF             - coefficient of the Spiky
-// kernel, depending on EFFECT_RADIUS
+// POLY6_COEFF             - coefficient of the Poly6 kernel
+// SPIKY_COEFF             - coefficient of the Spiky kernel
+#define EFFECT_RADIUS ((float)BOX_SIZE / GRID_RES)
+#define ABS_WALL_POS (BOX_SIZE / 2.0f)
+#define GRID_CELL_SIZE ((float)BOX_SIZE / GRID_RES)
+#define GRID_NUM_CELLS (GRID_RES * GRID_RES * GRID_RES)
+#define EFFECT_RADIUS_3 (EFFECT_RADIUS * EFFECT_RADIUS * EFFECT_RADIUS)
+#define POLY6_COEFF                                                            \
+  (315.0f / (64.0f * M_PI_F * EFFECT_RADIUS_3 * EFFECT_RADIUS_3 *              \
+             EFFECT_RADIUS_3))
+#define SPIKY_COEFF (15.0f / (M_PI_F * EFFECT_RADIUS_3 * EFFECT_RADIUS_3))
+#define MAX_VEL 30.0f
 
 #define ID get_global_id(0)
 #define GRAVITY_ACC (float4)(0.0f, -9.81f, 0.0f, 0.0f)
 #define FLOAT_EPS 0.00000001f
 
-// See FluidKernelInputs in Fluids.cpp
+// See FluidKernelInputs in PositionBasedFluids.cpp, read from the u_fluidParams
+// constant buffer and copied to private memory at the start of each kernel
 typedef struct defFluidParams {
   float effectRadius;
   float restDensity;
@@ -114,12 +128,14 @@ inline float artPressure(const float4 vec, FluidParams fluid) {
   Fill position buffer with random positions
 */
 __kernel void randPosVertsFluid( // Param
-    const FluidParams fluid,     // 0
+    __constant FluidParams *params,     // 0
     // Output
     __global float4 *pos, // 1
     __global float4 *vel) // 2
 
 {
+  const FluidParams fluid = *params;
+
   const unsigned int randomIntX = parallelRNG(ID);
   const unsigned int randomIntY = parallelRNG(ID + 1);
   const unsigned int randomIntZ = parallelRNG(ID + 2);
@@ -145,10 +161,12 @@ __kernel void predictPosition(  // Input
     const __global float4 *pos, // 0
     const __global float4 *vel, // 1
     // Param
-    const FluidParams fluid,  // 2
+    __constant FluidParams *params,  // 2
                               // Output
     __global float4 *predPos) // 3
 {
+  const FluidParams fluid = *params;
+
   // No need to update global vel, as it will be reset later on
   const float4 newVel = vel[ID] + GRAVITY_ACC * fluid.timeStep;
 
@@ -163,10 +181,12 @@ __kernel void computeDensity(           // Input
     const __global float4 *predPos,     // 0
     const __global uint2 *startEndCell, // 1
     // Param
-    const FluidParams fluid, // 2
+    __constant FluidParams *params, // 2
                              // Output
     __global float *density) // 3
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
 
@@ -223,10 +243,12 @@ __kernel void computeConstraintFactor(  // Input
     const __global float *density,      // 1
     const __global uint2 *startEndCell, // 2
     // Param
-    const FluidParams fluid,     // 3
+    __constant FluidParams *params,     // 3
                                  // Output
     __global float *constFactor) // 4
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
   const float densityC = density[ID] / fluid.restDensity - 1.0f;
@@ -284,10 +306,12 @@ __kernel void computeConstraintCorrection( // Input
     const __global uint2 *startEndCell,    // 1
     const __global float4 *predPos,        // 2
     // Param
-    const FluidParams fluid,  // 3
+    __constant FluidParams *params,  // 3
                               // Output
     __global float4 *corrPos) // 4
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const float lambdaI = constFactor[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
@@ -346,11 +370,13 @@ __kernel void updateVel(            // Input
     const __global float4 *predPos, // 0
     const __global float4 *pos,     // 1
     // Param
-    const FluidParams fluid, // 2
+    __constant FluidParams *params, // 2
                              // Output
     __global float4 *vel)    // 3
 
 {
+  const FluidParams fluid = *params;
+
   // Preventing division by 0
   vel[ID] = vel[ID] =
       clamp((predPos[ID] - pos[ID]) / (fluid.timeStep + FLOAT_EPS), -MAX_VEL,
@@ -365,10 +391,12 @@ __kernel void computeVorticity(         // Input
     const __global uint2 *startEndCell, // 1
     const __global float4 *vel,         // 2
     // Param
-    const FluidParams fluid,    // 3
+    __constant FluidParams *params,    // 3
                                 // Output
     __global float4 *vorticity) // 4
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const float4 velocity = vel[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
@@ -414,10 +442,12 @@ __kernel void applyVorticityConfinement( // Input
     const __global uint2 *startEndCell,  // 1
     const __global float4 *vort,         // 2
     // Param
-    const FluidParams fluid, // 3
+    __constant FluidParams *params, // 3
                              // Output
     __global float4 *vel)    // 4
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const float4 vorticity = vort[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
@@ -466,10 +496,12 @@ __kernel void applyXsphViscosityCorrection( // Input
     const __global uint2 *startEndCell,     // 1
     const __global float4 *velIn,           // 2
     // Param
-    const FluidParams fluid, // 3
+    __constant FluidParams *params, // 3
                              // Output
     __global float4 *velOut) // 4
 {
+  const FluidParams fluid = *params;
+
   const float4 pos = predPos[ID];
   const float4 velocity = velIn[ID];
   const uint3 cellIndex3D = getCell3DIndexFromPos(pos);
@@ -538,10 +570,12 @@ __kernel void updatePosition(       // Input
 __kernel void fillFluidColor(      // Input
     const __global float *density, // 0
     // Param
-    const FluidParams fluid, // 1
+    __constant FluidParams *params, // 1
                              // Output
     __global float4 *col)    // 2
 {
+  const FluidParams fluid = *params;
+
   float red = 0.0f;
   float green = 0.259f;
   float blue = 1.0f;
@@ -1,3 +1,4 @@
+// Defined in fluids.cl, which comes first in the program
 // ABS_WALL_POS            - absolute position of the walls in x,y,z
 // GRID_RES                - resolution of the grid
 // GRID_CELL_SIZE          - size of a cell, size / res of grid
@@ -43,8 +44,8 @@ __kernel void resetGridDetector(__global float8 *gridDetector) {
 /*
   Fill grid detector buffer. For rendering purpose only.
 */
-__kernel void fillGridDetector(__global float4 *pPos,
-                               __global float8 *gridDetector) {
+__kernel void fillGridDetector(const __global float4 *pPos,
+                                     __global float8 *gridDetector) {
   const float4 pos = pPos[ID];
 
   const uint gridDetectorIndex = getCell1DIndexFromPos(pos);
@@ -59,7 +60,7 @@ __kernel void fillGridDetector(__global float4 *pPos,
 __kernel void resetCellIDs(__global uint *pCellID) {
   // For all particles, giving cell ID above any available one
   // the ones not filled later (i.e not processed because index > nbParticles
-  // displayed) will be sorted at the end and not considered after sorting
+  // displayed) are past the range sorted and never considered
   pCellID[ID] = GRID_NUM_CELLS * 2 + ID;
 }
 
@@ -1,13 +1,19 @@
 // Mesher system, it uses TSDF voxel grid construction then marching cube to
 // reconstruct fluid suface
 
+// BOX_SIZE                 - Size of the simulation domain
 // TSDF_GRID_RES            - TSDF grid resolution
-// TSDF_GRID_CELL_SIZE      - TSDF number of cells
-// TSDF_GRID_NUM_CELLS      - TSDF grid number of cells
-// ABS_WALL_POS             - Absolute position of the walls in x,y,z
 // TSDF_NUM_MAX_PARTS_IN_CELL   - maximum number of particles taking into
 // account in a single cell in simplified mode
 
+// Derived from them
+// TSDF_GRID_CELL_SIZE      - TSDF size of a cell
+// TSDF_GRID_NUM_CELLS      - TSDF grid number of cells
+// ABS_WALL_POS             - Absolute position of the walls in x,y,z
+#define TSDF_GRID_CELL_SIZE ((float)BOX_SIZE / TSDF_GRID_RES)
+#define TSDF_GRID_NUM_CELLS (TSDF_GRID_RES * TSDF_GRID_RES * TSDF_GRID_RES)
+#define ABS_WALL_POS (BOX_SIZE / 2.0f)
+
 #define ID get_global_id(0)
 
 /*
@@ -42,7 +48,7 @@ inline uint TSDF_getCell1DIndexFromPos(float4 pos) {
 __kernel void TSDF_resetCellIDs(__global uint *TSDFCellID) {
   // For all particles, giving cell ID above any available one
   // the ones not filled later (i.e not processed because index > nbParticles
-  // displayed) will be sorted at the end and not considered after sorting
+  // displayed) are past the range sorted and never considered
   TSDFCellID[ID] = TSDF_GRID_NUM_CELLS * 2 + ID;
 }
 
@@ -50,10 +56,10 @@ __kernel void TSDF_resetCellIDs(__global uint *TSDFCellID) {
   Fill cellID buffer. For radix sort purpose.
 */
 __kernel void TSDF_fillCellIDs( // Input
-    const __global float4 *TSDFPartPosTmp,
+    const __global float4 *TSDFPartPos,
     // Output
     __global uint *TSDFCellID) {
-  const float4 pos = TSDFPartPosTmp[ID];
+  const float4 pos = TSDFPartPos[ID];
 
   const uint cell1DIndex = TSDF_getCell1DIndexFromPos(pos);
 
@@ -71,6 +77,8 @@ __kernel void TSDF_resetStartEndCell(__global uint2 *TSDFPartStartEndID) {
 
 /*
   Find first partID for each cell.
+  Particles are only sorted through indices: start and end are positions in
+  the sorted order, particle at position i being TSDFSortedIndices[i].
 */
 __kernel void TSDF_fillStartCell( // Input
     const __global uint *TSDFCellID,
@@ -78,12 +86,11 @@ __kernel void TSDF_fillStartCell( // Input
     __global uint2 *TSDFPartStartEndID) {
   const uint currentCellID = TSDFCellID[ID];
 
-  if (ID > 0 && currentCellID < TSDF_GRID_NUM_CELLS) {
-    uint leftCellID = TSDFCellID[ID - 1];
-    if (currentCellID != leftCellID) {
-      // Found start
-      TSDFPartStartEndID[currentCellID].x = ID;
-    }
+  // First sorted particle always starts its cell
+  if (currentCellID < TSDF_GRID_NUM_CELLS &&
+      (ID == 0 || currentCellID != TSDFCellID[ID - 1])) {
+    // Found start
+    TSDFPartStartEndID[currentCellID].x = ID;
   }
 }
 
@@ -96,12 +103,11 @@ __kernel void TSDF_fillEndCell( // Input
     __global uint2 *TSDFPartStartEndID) {
   const uint currentCellID = TSDFCellID[ID];
 
-  if (ID != get_global_size(0) && currentCellID < TSDF_GRID_NUM_CELLS) {
-    const uint rightCellID = TSDFCellID[ID + 1];
-    if (currentCellID != rightCellID) {
-      // Found end
-      TSDFPartStartEndID[currentCellID].y = ID;
-    }
+  // Launched on the active particles only, cell IDs after them are not sorted
+  if (currentCellID < TSDF_GRID_NUM_CELLS &&
+      (ID == get_global_size(0) - 1 || currentCellID != TSDFCellID[ID + 1])) {
+    // Found end
+    TSDFPartStartEndID[currentCellID].y = ID;
   }
 }
 
@@ -120,25 +126,59 @@ __kernel void TSDF_adjustEndCell(__global uint2 *TSDFPartStartEndID) {
 }
 
 /*
-    Compute TSDF grid value, using iso kernel
+  Compute TSDF grid value, using iso kernel.
+  Distance from the cell center to the weighted mean of the particles of the
+  cell, minus a particle radius (Zhu and Bridson 2005), truncated to a cell
+  size. Particles are visited in sorted order through the indices, start and
+  end being inclusive positions in that order.
 */
 __kernel void TSDF_computeGrid(
     // Inputs
     const __global uint *TSDFCellID, const __global uint2 *TSDFPartStartEndID,
-    const __global float4 *TSDFPartPosTmp,
+    const __global uint *TSDFSortedIndices, const __global float4 *TSDFPartPos,
     // output
-    __global float4 *TSDFGrid) {
+    __global float *TSDFGrid) {
+
+  const float radius = 0.5f * TSDF_GRID_CELL_SIZE;
 
-  // Particule relative informations
-  const float4 pos = TSDFPartPosTmp[ID];
-  const uint3 cellIndex3D = TSDF_getCell3DIndexFromPos(pos);
-  // uint cellIndex1D =
-  //     (cellIndex3D.x * GRID_RES + cellIndex3D.y) * GRID_RES + cellIndex3D.z;
+  // Empty cell, fully outside of the fluid
+  const uint2 startEnd = TSDFPartStartEndID[ID];
+  if (startEnd.x > startEnd.y) {
+    TSDFGrid[ID] = TSDF_GRID_CELL_SIZE;
+    return;
+  }
 
-  // Init TSDF grid
-  // TSDFGrid[cell1DIndex] = (float)(0);
+  const uint3 cellIndex3D =
+      (uint3)(ID / (TSDF_GRID_RES * TSDF_GRID_RES),
+              (ID / TSDF_GRID_RES) % TSDF_GRID_RES, ID % TSDF_GRID_RES);
+  const float3 cellCenter =
+      (convert_float3(cellIndex3D) + (float3)(0.5f)) * TSDF_GRID_CELL_SIZE -
+      (float3)(ABS_WALL_POS);
 
   // Local SDF init
-  float3 sumX = {0, 0, 0};
-  float sumWeight = 0;
-}
\ No newline at end of file
+  float3 sumX = (float3)(0.0f);
+  float sumWeight = 0.0f;
+
+  for (uint i = startEnd.x; i <= startEnd.y; ++i) {
+    // Particule relative informations, gathered through the sorted indices
+    const float3 pos = TSDFPartPos[TSDFSortedIndices[i]].xyz;
+
+    // Iso kernel, (1 - (d / h)^2)^3 with the cell diagonal as support
+    const float3 diff = pos - cellCenter;
+    const float ratio = dot(diff, diff) /
+                        (3.0f * TSDF_GRID_CELL_SIZE * TSDF_GRID_CELL_SIZE);
+    const float weight = pown(max(1.0f - ratio, 0.0f), 3);
+
+    sumX += weight * pos;
+    sumWeight += weight;
+  }
+
+  // Only particles clamped from outside the walls can be out of the support
+  const float3 meanPos =
+      (sumWeight > 0.0f)
+          ? sumX / sumWeight
+          : TSDFPartPos[TSDFSortedIndices[startEnd.x]].xyz;
+
+  TSDFGrid[ID] = min(distance(cellCenter, meanPos) - radius,
+                     (float)TSDF_GRID_CELL_SIZE);
+}
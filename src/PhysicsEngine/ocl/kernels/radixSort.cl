@@ -3,6 +3,7 @@
 // _BITS             - size of radix in bits
 // _GROUPS           - number of work groups
 // _ITEMS            - number of work items
+// _TILE             - number of keys a group reorders at once in local memory
 // HOST_PTR_IS_32bit - only if 32bit OS
 
 #ifdef HOST_PTR_IS_32bit
@@ -36,10 +37,12 @@ __kernel void histogram(//Input
   }
   barrier(CLK_LOCAL_MEM_FENCE);
 
-  const SIZE size = length / (_GROUPS * _ITEMS);
+  // Last chunks are shorter, or empty, when length is not a multiple of _GROUPS * _ITEMS
+  const SIZE size = (length + _GROUPS * _ITEMS - 1) / (_GROUPS * _ITEMS);
   const SIZE start = i_g * size;
+  const SIZE end = min(start + size, length);
 
-  for (SIZE i = start; i < start + size; ++i)
+  for (SIZE i = start; i < end; ++i)
   {
     const uint key = keys[i];
     const uint shortKey = ((key >> (pass * _BITS)) & (_RADIX - 1));
@@ -129,6 +132,13 @@ __kernel void scan(//Input/Output
   input[gid2 + 1] = temp[(item << 1) + 1];
 }
 
+/*
+  Scatter the keys of each group to their sorted position for one pass.
+  The keys of a group go through local memory by tiles: ranked by digit in the
+  tile, then written as runs of equal digits by consecutive items.
+  Ranks are stable: each item ranks consecutive keys of the tile and tiles are
+  processed in order.
+*/
 __kernel void reorder(//Input
                       const __global uint *keysIn,           // 0
                       const __global uint *permutationIn,    // 1
@@ -136,35 +146,125 @@ __kernel void reorder(//Input
                       const __global uint *histograms,       // 3
                       const          int  pass,              // 4
                       //Output
-                            __global uint *keysOut,          // 5 
+                            __global uint *keysOut,          // 5
                             __global uint *permutationOut,   // 6
                       //Local
                             __local  uint *local_histograms) // 7
 {
-  const int item = get_local_id(0);
-  const int group = get_group_id(0);
+  __local uint tileKeys[_TILE];
+  __local uint tilePermutation[_TILE];
+  // Keys of the tile sorted by digit
+  __local uint sortedKeys[_TILE];
+  __local uint sortedPermutation[_TILE];
+  // First position and count of each digit in the sorted tile
+  __local uint tileDigitStart[_RADIX];
+  __local uint tileDigitCount[_RADIX];
+  // Position of the next key of the group for each digit
+  __local uint groupOffsets[_RADIX];
+  __local uint segmentSums[_ITEMS];
 
-  const SIZE size = length / (_GROUPS * _ITEMS);
-  const SIZE start = get_global_id(0) * size;
+  const uint item = get_local_id(0);
+  const uint group = get_group_id(0);
+  const uint keysPerItem = _TILE / _ITEMS;
+  const uint firstDigit = item * (_RADIX / _ITEMS);
+  const uint lastDigit = firstDigit + (_RADIX / _ITEMS);
 
-  for (int i = 0; i < _RADIX; ++i)
+  // Same chunks as in histogram, a group covers the chunks of all its items
+  const SIZE size = (length + _GROUPS * _ITEMS - 1) / (_GROUPS * _ITEMS);
+  const SIZE groupStart = min((SIZE)group * _ITEMS * size, length);
+  const SIZE groupEnd = min(groupStart + _ITEMS * size, length);
+
+  // Scanned histograms are ordered by digit, group then item, so the first
+  // item of the group holds the position of the group keys for each digit
+  for (uint digit = item; digit < _RADIX; digit += _ITEMS)
   {
-    local_histograms[i * _ITEMS + item] = histograms[i * _GROUPS * _ITEMS + _ITEMS * group + item];
+    groupOffsets[digit] = histograms[digit * _GROUPS * _ITEMS + _ITEMS * group];
   }
-  barrier(CLK_LOCAL_MEM_FENCE);
 
-  for (SIZE i = start; i < start + size; ++i)
+  for (SIZE tileStart = groupStart; tileStart < groupEnd; tileStart += _TILE)
   {
-    const uint key = keysIn[i];
-    const uint digit = ((key >> (pass * _BITS)) & (_RADIX - 1));
-    const uint newPosition = local_histograms[digit * _ITEMS + item];
+    const uint tileLength = min((SIZE)_TILE, groupEnd - tileStart);
+
+    for (uint i = item; i < tileLength; i += _ITEMS)
+    {
+      tileKeys[i] = keysIn[tileStart + i];
+      tilePermutation[i] = permutationIn[tileStart + i];
+    }
+
+    for (int i = 0; i < _RADIX; ++i)
+    {
+      local_histograms[i * _ITEMS + item] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const uint itemStart = min(item * keysPerItem, tileLength);
+    const uint itemEnd = min(itemStart + keysPerItem, tileLength);
+
+    for (uint i = itemStart; i < itemEnd; ++i)
+    {
+      const uint digit = ((tileKeys[i] >> (pass * _BITS)) & (_RADIX - 1));
+      ++local_histograms[digit * _ITEMS + item];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Each item scans a segment of the digits, over the items first then over
+    // the digits
+    uint segmentSum = 0;
+    for (uint digit = firstDigit; digit < lastDigit; ++digit)
+    {
+      uint digitCount = 0;
+      for (int i = 0; i < _ITEMS; ++i)
+      {
+        const uint count = local_histograms[digit * _ITEMS + i];
+        local_histograms[digit * _ITEMS + i] = digitCount;
+        digitCount += count;
+      }
+      tileDigitStart[digit] = segmentSum;
+      tileDigitCount[digit] = digitCount;
+      segmentSum += digitCount;
+    }
+    segmentSums[item] = segmentSum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint segmentStart = 0;
+    for (uint i = 0; i < item; ++i)
+    {
+      segmentStart += segmentSums[i];
+    }
+
+    for (uint digit = firstDigit; digit < lastDigit; ++digit)
+    {
+      tileDigitStart[digit] += segmentStart;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-    local_histograms[digit * _ITEMS + item] = newPosition + 1;
+    for (uint i = itemStart; i < itemEnd; ++i)
+    {
+      const uint key = tileKeys[i];
+      const uint digit = ((key >> (pass * _BITS)) & (_RADIX - 1));
+      const uint localPosition = tileDigitStart[digit] + local_histograms[digit * _ITEMS + item]++;
+
+      sortedKeys[localPosition] = key;
+      sortedPermutation[localPosition] = tilePermutation[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Consecutive items write consecutive positions inside a run of equal digits
+    for (uint i = item; i < tileLength; i += _ITEMS)
+    {
+      const uint key = sortedKeys[i];
+      const uint digit = ((key >> (pass * _BITS)) & (_RADIX - 1));
+      const uint newPosition = groupOffsets[digit] + i - tileDigitStart[digit];
+
+      keysOut[newPosition] = key;
+      permutationOut[newPosition] = sortedPermutation[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-    // WRITE TO GLOBAL (slow)
-    keysOut[newPosition] = key;
-    permutationOut[newPosition] = permutationIn[i];
-    //
+    for (uint digit = firstDigit; digit < lastDigit; ++digit)
+    {
+      groupOffsets[digit] += tileDigitCount[digit];
+    }
   }
 }
 
@@ -187,6 +287,78 @@ __kernel void permutate(//Input
   permutatedVal[ID] = valToPermutate[newIndex];
 }
 
+/*
+  Permutate 2 float4 attributes at once, indices are read a single time.
+*/
+__kernel void permutate2(//Input
+                         const __global uint   *permutatedIndices, // 0
+                         const __global float4 *valToPermutate0,   // 1
+                         //Output
+                               __global float4 *permutatedVal0,    // 2
+                         //Input
+                         const __global float4 *valToPermutate1,   // 3
+                         //Output
+                               __global float4 *permutatedVal1)    // 4
+{
+  const uint newIndex = permutatedIndices[ID];
+
+  permutatedVal0[ID] = valToPermutate0[newIndex];
+  permutatedVal1[ID] = valToPermutate1[newIndex];
+}
+
+/*
+  Permutate 3 float4 attributes at once, indices are read a single time.
+*/
+__kernel void permutate3(//Input
+                         const __global uint   *permutatedIndices, // 0
+                         const __global float4 *valToPermutate0,   // 1
+                         //Output
+                               __global float4 *permutatedVal0,    // 2
+                         //Input
+                         const __global float4 *valToPermutate1,   // 3
+                         //Output
+                               __global float4 *permutatedVal1,    // 4
+                         //Input
+                         const __global float4 *valToPermutate2,   // 5
+                         //Output
+                               __global float4 *permutatedVal2)    // 6
+{
+  const uint newIndex = permutatedIndices[ID];
+
+  permutatedVal0[ID] = valToPermutate0[newIndex];
+  permutatedVal1[ID] = valToPermutate1[newIndex];
+  permutatedVal2[ID] = valToPermutate2[newIndex];
+}
+
+/*
+  Permutate 4 float4 attributes at once, indices are read a single time.
+*/
+__kernel void permutate4(//Input
+                         const __global uint   *permutatedIndices, // 0
+                         const __global float4 *valToPermutate0,   // 1
+                         //Output
+                               __global float4 *permutatedVal0,    // 2
+                         //Input
+                         const __global float4 *valToPermutate1,   // 3
+                         //Output
+                               __global float4 *permutatedVal1,    // 4
+                         //Input
+                         const __global float4 *valToPermutate2,   // 5
+                         //Output
+                               __global float4 *permutatedVal2,    // 6
+                         //Input
+                         const __global float4 *valToPermutate3,   // 7
+                         //Output
+                               __global float4 *permutatedVal3)    // 8
+{
+  const uint newIndex = permutatedIndices[ID];
+
+  permutatedVal0[ID] = valToPermutate0[newIndex];
+  permutatedVal1[ID] = valToPermutate1[newIndex];
+  permutatedVal2[ID] = valToPermutate2[newIndex];
+  permutatedVal3[ID] = valToPermutate3[newIndex];
+}
+
 /*
   Permutate uint values.
 */
@@ -0,0 +1,222 @@
+// Single pass radix sort based on
+// Adinets and Merrill 2022. "Onesweep: A Faster Least Significant Digit Radix
+// Sort for GPUs"
+// All digit histograms are computed upfront, then each pass scatters the keys
+// once, tiles getting their offsets through a decoupled look-back (chained
+// scan) on the counts of the tiles before them.
+//
+// Forward progress is NOT guaranteed: a tile spins until the tiles before it,
+// in other work groups, publish their counts. Numbering tiles with an atomic
+// counter only avoids a deadlock if the device keeps running groups that have
+// started, which OpenCL 1.2 does not promise. This backend is opt-in only, it
+// must stay off by default until validated on each target vendor.
+
+// Preprocessor defines following constant variables in RadixSort.cpp
+// _RADIX            - number of radix
+// _BITS             - size of radix in bits
+// _PASSES           - number of radix passes
+// _ITEMS            - number of work items of a tile
+// _KEYS_PER_ITEM    - number of consecutive keys ranked by each work item
+// HOST_PTR_IS_32bit - only if 32bit OS
+
+#ifdef HOST_PTR_IS_32bit
+#define SIZE uint
+#else
+#define SIZE ulong
+#endif
+
+#define ID get_global_id(0)
+#define TILE_SIZE (_ITEMS * _KEYS_PER_ITEM)
+
+// Look-back status of a digit of a tile, count in the low bits
+// AGGREGATE : count of the tile only, PREFIX : count of the tile and all the
+// ones before it
+#define STATUS_AGGREGATE (1u << 30)
+#define STATUS_PREFIX (2u << 30)
+#define STATUS_FLAGS (3u << 30)
+#define STATUS_COUNT (~STATUS_FLAGS)
+
+inline uint getDigit(const uint key, const int pass) {
+  return (key >> (pass * _BITS)) & (_RADIX - 1);
+}
+
+/*
+  Clear histograms, tile counters and look-back status before a sort
+*/
+__kernel void onesweepClear(//Output
+                            __global uint *histograms,   // 0
+                            __global uint *tileCounters, // 1
+                            __global uint *lookBack)     // 2
+{
+  if (ID < _PASSES * _RADIX)
+    histograms[ID] = 0;
+
+  if (ID < _PASSES)
+    tileCounters[ID] = 0;
+
+  lookBack[ID] = 0;
+}
+
+/*
+  Count the digits of every pass in a single read of the keys
+*/
+__kernel void onesweepHistogram(//Input
+                                const __global uint *keys,       // 0
+                                const          SIZE length,      // 1
+                                //Output
+                                      __global uint *histograms) // 2
+{
+  __local uint localHistograms[_PASSES * _RADIX];
+
+  for (uint i = get_local_id(0); i < _PASSES * _RADIX; i += get_local_size(0))
+    localHistograms[i] = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (SIZE i = ID; i < length; i += get_global_size(0))
+  {
+    const uint key = keys[i];
+    for (int pass = 0; pass < _PASSES; ++pass)
+      atomic_inc(&localHistograms[pass * _RADIX + getDigit(key, pass)]);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint i = get_local_id(0); i < _PASSES * _RADIX; i += get_local_size(0))
+  {
+    if (localHistograms[i] > 0)
+      atomic_add(&histograms[i], localHistograms[i]);
+  }
+}
+
+/*
+  Exclusive scan of the histogram of each pass, one work group of _RADIX items
+  per pass. Histograms then hold the first position of each digit.
+*/
+__kernel void onesweepScan(//Input/Output
+                           __global uint *histograms) // 0
+{
+  __local uint temp[_RADIX];
+
+  const uint item = get_local_id(0);
+  const uint count = histograms[ID];
+
+  temp[item] = count;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Inclusive scan of Hillis and Steele 1986
+  for (uint offset = 1; offset < _RADIX; offset <<= 1)
+  {
+    const uint value = (item >= offset) ? temp[item - offset] : 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    temp[item] += value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  histograms[ID] = temp[item] - count;
+}
+
+/*
+  Scatter the keys of a tile to their sorted position for one pass.
+  Ranks are stable: each item ranks consecutive keys, items are ordered inside
+  the tile and tiles are ordered by the look-back.
+*/
+__kernel void onesweepScatter(//Input
+                              const __global uint *keysIn,         // 0
+                              const __global uint *permutationIn,  // 1
+                              const          SIZE length,          // 2
+                              const __global uint *digitOffsets,   // 3
+                              const          int  pass,            // 4
+                              //Output
+                                    __global uint *keysOut,        // 5
+                                    __global uint *permutationOut, // 6
+                              //Input/Output
+                                    __global uint *tileCounters,   // 7
+                                    __global uint *lookBack)       // 8
+{
+  __local uint tileID;
+  // Count of each digit per item, then position of the next key of the item
+  // among the keys of the tile with the same digit
+  __local ushort itemCounts[_RADIX * _ITEMS];
+  // Number of keys with the same digit in all the tiles before
+  __local uint tilePrefix[_RADIX];
+
+  const uint item = get_local_id(0);
+
+  // Tiles are numbered in the order groups start, a tile only waits for tiles
+  // which are already running
+  if (item == 0)
+    tileID = atomic_inc(&tileCounters[pass]);
+
+  for (int digit = 0; digit < _RADIX; ++digit)
+    itemCounts[digit * _ITEMS + item] = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const uint tile = tileID;
+  const SIZE start = (SIZE)tile * TILE_SIZE + item * _KEYS_PER_ITEM;
+  const SIZE end = min(start + _KEYS_PER_ITEM, length);
+
+  for (SIZE i = start; i < end; ++i)
+    ++itemCounts[getDigit(keysIn[i], pass) * _ITEMS + item];
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  __global uint *passStatus = lookBack + (SIZE)pass * get_num_groups(0) * _RADIX;
+
+  for (uint digit = item; digit < _RADIX; digit += _ITEMS)
+  {
+    // Exclusive scan over the items of the tile
+    uint tileCount = 0;
+    for (int i = 0; i < _ITEMS; ++i)
+    {
+      const uint count = itemCounts[digit * _ITEMS + i];
+      itemCounts[digit * _ITEMS + i] = tileCount;
+      tileCount += count;
+    }
+
+    __global uint *status = passStatus + tile * _RADIX + digit;
+
+    if (tile == 0)
+    {
+      atomic_xchg(status, STATUS_PREFIX | tileCount);
+      tilePrefix[digit] = 0;
+      continue;
+    }
+
+    // Published first, tiles after this one can go on without waiting for its
+    // prefix
+    atomic_xchg(status, STATUS_AGGREGATE | tileCount);
+
+    uint prefix = 0;
+    int previousTile = tile - 1;
+    while (previousTile >= 0)
+    {
+      // Atomic read, never cached
+      const uint previousStatus = atomic_or(&passStatus[previousTile * _RADIX + digit], 0);
+      const uint flags = previousStatus & STATUS_FLAGS;
+
+      // Not published yet
+      if (flags == 0)
+        continue;
+
+      prefix += previousStatus & STATUS_COUNT;
+      if (flags == STATUS_PREFIX)
+        break;
+
+      --previousTile;
+    }
+
+    atomic_xchg(status, STATUS_PREFIX | (prefix + tileCount));
+    tilePrefix[digit] = prefix;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (SIZE i = start; i < end; ++i)
+  {
+    const uint key = keysIn[i];
+    const uint digit = getDigit(key, pass);
+    const uint rank = itemCounts[digit * _ITEMS + item]++;
+    const uint newPosition = digitOffsets[pass * _RADIX + digit] + tilePrefix[digit] + rank;
+
+    keysOut[newPosition] = key;
+    // Identity permutation before the first pass
+    permutationOut[newPosition] = (pass == 0) ? (uint)i : permutationIn[i];
+  }
+}
@@ -18,14 +18,19 @@
 #include "../ocl/Context.hpp"
 
 #include "Logger.h"
+#include <algorithm>
+#include <chrono>
 #include <ctime>
-#include <iostream>
+#include <iterator>
+#include <limits>
 #include <numeric>
+#include <random>
 #include <sstream>
 
 using namespace Physics;
 
 #define PROGRAM_RADIXSORT "RadixSort"
+#define PROGRAM_RADIXSORT_ONESWEEP "RadixSortOnesweep"
 
 #define KERNEL_RESET_INDEX "resetIndex"
 #define KERNEL_HISTOGRAM "histogram"
@@ -33,20 +38,89 @@ using namespace Physics;
 #define KERNEL_SCAN "scan"
 #define KERNEL_REORDER "reorder"
 #define KERNEL_PERMUTATE "permutate"
+#define KERNEL_PERMUTATE_2 "permutate2"
+#define KERNEL_PERMUTATE_3 "permutate3"
+#define KERNEL_PERMUTATE_4 "permutate4"
 
-RadixSort::RadixSort(size_t numEntities)
-    : m_numEntities(numEntities)
-    , m_numRadix(256)
-    , m_numRadixBits(8)
+#define KERNEL_ONESWEEP_CLEAR "onesweepClear"
+#define KERNEL_ONESWEEP_HISTOGRAM "onesweepHistogram"
+#define KERNEL_ONESWEEP_SCAN "onesweepScan"
+#define KERNEL_ONESWEEP_SCATTER "onesweepScatter"
+
+namespace
+{
+// Groups x items, the scan needs their product to be a power of two
+constexpr std::array<std::pair<unsigned int, unsigned int>, 6> TUNING_CONFIGURATIONS { { { 64, 4 }, { 128, 4 }, { 256, 4 }, { 64, 8 }, { 128, 8 }, { 256, 8 } } };
+
+// Sorts timed per configuration, the first ones include the warm up of the device
+constexpr int NUM_TUNING_SORTS = 32;
+
+// Largest permutate kernel of the program
+constexpr size_t MAX_FUSED_PERMUTATIONS = 4;
+
+// Keys a reorder group ranks in local memory before writing them, a multiple of every tuned number of items
+constexpr unsigned int REORDER_TILE_SIZE = RADIX_SORT_TILE;
+
+// Onesweep tile sizes, the largest whose per item counts fit in local memory is used
+constexpr std::array<unsigned int, 2> ONESWEEP_ITEMS { RADIX_SORT_ONESWEEP_ITEMS, RADIX_SORT_ONESWEEP_ITEMS / 2 };
+constexpr unsigned int ONESWEEP_KEYS_PER_ITEM = RADIX_SORT_ONESWEEP_KEYS_PER_ITEM;
+
+// On failure, firstMismatch is the first sorted position whose key is not the one the permutation points to
+template <typename T, typename U>
+bool checkPermutation(const std::vector<T>& keysAfterSort,
+    const std::vector<T>& keysBeforeSort,
+    const std::vector<U>& permutation,
+    size_t& firstMismatch)
+{
+  for (size_t i = 0; i < keysAfterSort.size(); ++i)
+  {
+    if (permutation[i] >= keysBeforeSort.size() || keysBeforeSort[permutation[i]] != keysAfterSort[i])
+    {
+      firstMismatch = i;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Generator of values in [0, upperBound], seeded from the clock
+template <typename T>
+auto makeRng(T upperBound)
+{
+  return [engine = std::minstd_rand(static_cast<std::minstd_rand::result_type>(std::chrono::steady_clock::now().time_since_epoch().count())),
+             distribution = std::uniform_int_distribution<T>(0, upperBound)]() mutable
+  { return distribution(engine); };
+}
+}
+
+RadixSort::RadixSort(CL::Context& context, size_t numEntities, const std::string& scratchAliasGroup)
+    : m_context(context)
+    , m_numEntities(numEntities)
+    , m_scratchAliasGroup(scratchAliasGroup)
+    , m_numRadix(1 << RADIX_SORT_BITS)
+    , m_numRadixBits(RADIX_SORT_BITS)
     , m_numTotalBits(32)
-    , m_numGroups(128)
-    , m_numItems(4)
+    , m_numGroups(RADIX_SORT_GROUPS)
+    , m_numItems(RADIX_SORT_ITEMS)
     , m_histoSplit(256)
+    , m_backend(Backend::MULTI_PASS)
+    , m_onesweepItems(0)
+    , m_onesweepKeysPerItem(ONESWEEP_KEYS_PER_ITEM)
 {
   m_numRadixPasses = m_numTotalBits / m_numRadixBits;
 
-  if (m_numEntities % (m_numGroups * m_numItems) != 0)
-    LOG_ERROR("Radix sort not supporting arrays of size {}, only ones whose size is multiple of {} ", m_numEntities, m_numGroups * m_numItems);
+  selectConfiguration();
+
+  // Scan runs one item per digit, scatter keeps a 16 bits count per digit and item plus a 32 bits prefix per digit
+  for (const unsigned int numItems : ONESWEEP_ITEMS)
+  {
+    const size_t scatterLocalMem = sizeof(uint16_t) * m_numRadix * numItems + sizeof(unsigned int) * (m_numRadix + 1);
+    if (m_numRadix <= m_context.getMaxWorkGroupSize() && scatterLocalMem <= m_context.getLocalMemSize())
+    {
+      m_onesweepItems = numItems;
+      break;
+    }
+  }
 
   if (!createProgram())
   {
@@ -60,122 +134,546 @@ RadixSort::RadixSort(size_t numEntities)
     return;
   }
 
-  if (!createKernels())
+  // Kernels are created later by the owner, once every other program build has been started
+}
+
+void RadixSort::selectConfiguration()
+{
+  CL::Context& clContext = m_context;
+
+  std::string value;
+  unsigned int tunedGroups;
+  unsigned int tunedItems;
+  if (clContext.findTuning(getTuningKey(), value) && (std::istringstream(value) >> tunedGroups >> tunedItems) && isValidConfiguration(tunedGroups, tunedItems))
   {
-    LOG_ERROR("Failed to initialize radix sort kernels");
+    m_numGroups = tunedGroups;
+    m_numItems = tunedItems;
+    LOG_INFO("Radix sort using tuned configuration of {} groups of {} items", m_numGroups, m_numItems);
     return;
   }
 
-  LOG_INFO("Radix sort correctly initialized");
+  if (!clContext.isAutotuning())
+    return;
+
+  // Default configuration is the one of the main program, the others get a program of their own
+  for (const auto& [numGroups, numItems] : TUNING_CONFIGURATIONS)
+  {
+    if (!isValidConfiguration(numGroups, numItems))
+      continue;
+
+    const bool isDefault = (numGroups == m_numGroups && numItems == m_numItems);
+    const std::string programName = isDefault ? PROGRAM_RADIXSORT : PROGRAM_RADIXSORT "_" + std::to_string(numGroups) + "x" + std::to_string(numItems);
+    m_tuningVariants.push_back({ numGroups, numItems, programName });
+  }
+
+  LOG_INFO("Radix sort tuning {} configurations of groups and items", m_tuningVariants.size());
 }
 
-bool RadixSort::createProgram() const
+bool RadixSort::isValidConfiguration(unsigned int numGroups, unsigned int numItems) const
 {
-  CL::Context& clContext = CL::Context::Get();
+  const CL::Context& clContext = m_context;
+
+  const size_t numScanItems = m_numRadix * numGroups * numItems / 2 / m_histoSplit;
+  const size_t scanLocalMem = sizeof(unsigned int) * std::max<size_t>(m_histoSplit, m_numRadix * numGroups * numItems / m_histoSplit);
+  const size_t histogramLocalMem = sizeof(unsigned int) * m_numRadix * numItems;
+  // Histograms, 4 tile arrays, 3 values per digit and 1 per item
+  const size_t reorderLocalMem = histogramLocalMem + sizeof(unsigned int) * (4 * REORDER_TILE_SIZE + 3 * m_numRadix + numItems);
+
+  return (numScanItems <= clContext.getMaxWorkGroupSize())
+      && (std::max(scanLocalMem, reorderLocalMem) <= clContext.getLocalMemSize());
+}
 
+std::string RadixSort::getTuningKey() const
+{
+  return "RadixSort/" + std::to_string(m_numEntities);
+}
+
+std::string RadixSort::getBuildOptions(unsigned int numGroups, unsigned int numItems) const
+{
   std::ostringstream clBuildOptions;
   clBuildOptions << " -D_RADIX=" << m_numRadix;
   clBuildOptions << " -D_BITS=" << m_numRadixBits;
-  clBuildOptions << " -D_GROUPS=" << m_numGroups;
-  clBuildOptions << " -D_ITEMS=" << m_numItems;
+  clBuildOptions << " -D_GROUPS=" << numGroups;
+  clBuildOptions << " -D_ITEMS=" << numItems;
+  clBuildOptions << " -D_TILE=" << REORDER_TILE_SIZE;
   if (sizeof(void*) < 8)
   {
     clBuildOptions << " -DHOST_PTR_IS_32bit";
   }
 
-  if (!clContext.createProgram(PROGRAM_RADIXSORT, "radixSort.cl", clBuildOptions.str()))
+  return clBuildOptions.str();
+}
+
+bool RadixSort::createProgram() const
+{
+  CL::Context& clContext = m_context;
+
+  if (!clContext.createProgram(PROGRAM_RADIXSORT, "radixSort.cl", getBuildOptions(m_numGroups, m_numItems)).valid())
     return false;
 
+  // Variants build in the background as well, only their histogram, scan, merge and reorder kernels are used
+  for (const auto& variant : m_tuningVariants)
+  {
+    if (variant.programName != PROGRAM_RADIXSORT && !clContext.createProgram(variant.programName, "radixSort.cl", getBuildOptions(variant.numGroups, variant.numItems)).valid())
+      return false;
+  }
+
+  if (!isOnesweepSupported())
+    return true;
+
+  std::ostringstream onesweepBuildOptions;
+  onesweepBuildOptions << " -D_RADIX=" << m_numRadix;
+  onesweepBuildOptions << " -D_BITS=" << m_numRadixBits;
+  onesweepBuildOptions << " -D_PASSES=" << m_numRadixPasses;
+  onesweepBuildOptions << " -D_ITEMS=" << m_onesweepItems;
+  onesweepBuildOptions << " -D_KEYS_PER_ITEM=" << m_onesweepKeysPerItem;
+  if (sizeof(void*) < 8)
+  {
+    onesweepBuildOptions << " -DHOST_PTR_IS_32bit";
+  }
+
+  return clContext.createProgram(PROGRAM_RADIXSORT_ONESWEEP, "radixSortOnesweep.cl", onesweepBuildOptions.str()).valid();
+}
+
+bool RadixSort::createBuffers()
+{
+  CL::Context& clContext = m_context;
+
+  m_buffers.keysTemp = clContext.createBuffer("RadixSortKeysTemp", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE, "RadixSort");
+
+  // Shared by all the variants while tuning
+  unsigned int maxNumGroupItems = m_numGroups * m_numItems;
+  for (const auto& variant : m_tuningVariants)
+    maxNumGroupItems = std::max(maxNumGroupItems, variant.numGroups * variant.numItems);
+
+  m_buffers.histogram = clContext.createBuffer("RadixSortHistogram", sizeof(unsigned int) * m_numRadix * maxNumGroupItems, CL_MEM_READ_WRITE, "RadixSort");
+
+  m_buffers.sum = clContext.createBuffer("RadixSortSum", sizeof(unsigned int) * m_histoSplit, CL_MEM_READ_WRITE, "RadixSort");
+  m_buffers.tempSum = clContext.createBuffer("RadixSortTempSum", sizeof(unsigned int) * m_histoSplit, CL_MEM_READ_WRITE, "RadixSort");
+
+  m_buffers.indices = clContext.createBuffer("RadixSortIndices", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE, "RadixSort");
+  m_buffers.indicesTemp = clContext.createBuffer("RadixSortIndicesTemp", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE, "RadixSort");
+
+  // Only live while permutating, other transient buffers of the owner can use the same memory
+  if (m_scratchAliasGroup.empty())
+    m_buffers.permutateTemp = clContext.createBuffer("RadixSortPermutateTemp", 4 * sizeof(float) * m_numEntities, CL_MEM_READ_WRITE, "RadixSort");
+  else
+    m_buffers.permutateTemp = clContext.createArenaBuffer("RadixSortPermutateTemp", 4 * sizeof(float) * m_numEntities, "RadixSort", m_scratchAliasGroup);
+
+  if (isOnesweepSupported())
+  {
+    m_buffers.onesweepHistograms = clContext.createBuffer("RadixSortOnesweepHistograms", sizeof(unsigned int) * m_numRadixPasses * m_numRadix, CL_MEM_READ_WRITE, "RadixSort");
+    m_buffers.onesweepTileCounters = clContext.createBuffer("RadixSortOnesweepTileCounters", sizeof(unsigned int) * m_numRadixPasses, CL_MEM_READ_WRITE, "RadixSort");
+    // Status of each digit of each tile, for every pass
+    m_buffers.onesweepLookBack = clContext.createBuffer("RadixSortOnesweepLookBack", sizeof(unsigned int) * m_numRadixPasses * getOnesweepNumTiles(m_numEntities) * m_numRadix, CL_MEM_READ_WRITE, "RadixSort");
+  }
+
   return true;
 }
 
-bool RadixSort::createBuffers() const
+bool RadixSort::createKernels()
 {
-  CL::Context& clContext = CL::Context::Get();
+  CL::Context& clContext = m_context;
+
+  m_kernels.resetIndex = clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_RESET_INDEX, { "RadixSortIndices" });
 
-  clContext.createBuffer("RadixSortKeysTemp", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE);
+  MultiPassVariant mainVariant { m_numGroups, m_numItems, PROGRAM_RADIXSORT };
+  if (!createMultiPassKernels(mainVariant))
+  {
+    LOG_ERROR("Failed to initialize radix sort kernels");
+    return false;
+  }
+  useVariant(mainVariant);
 
-  clContext.createBuffer("RadixSortHistogram", sizeof(unsigned int) * m_numRadix * m_numGroups * m_numItems, CL_MEM_READ_WRITE);
+  m_kernels.permutate[0] = clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_PERMUTATE, { "RadixSortIndices" });
+  m_kernels.permutate[1] = clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_PERMUTATE_2, { "RadixSortIndices" });
+  m_kernels.permutate[2] = clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_PERMUTATE_3, { "RadixSortIndices" });
+  m_kernels.permutate[3] = clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_PERMUTATE_4, { "RadixSortIndices" });
 
-  clContext.createBuffer("RadixSortSum", sizeof(unsigned int) * m_histoSplit, CL_MEM_READ_WRITE);
-  clContext.createBuffer("RadixSortTempSum", sizeof(unsigned int) * m_histoSplit, CL_MEM_READ_WRITE);
+  if (!m_kernels.permutate.back().isValid())
+  {
+    LOG_ERROR("Failed to initialize radix sort kernels");
+    return false;
+  }
 
-  clContext.createBuffer("RadixSortIndices", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE);
-  clContext.createBuffer("RadixSortIndicesTemp", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE);
+  if (isOnesweepSupported())
+  {
+    m_kernels.onesweepClear = clContext.createKernel(PROGRAM_RADIXSORT_ONESWEEP, KERNEL_ONESWEEP_CLEAR,
+        { "RadixSortOnesweepHistograms", "RadixSortOnesweepTileCounters", "RadixSortOnesweepLookBack" });
+    m_kernels.onesweepHistogram = clContext.createKernel(PROGRAM_RADIXSORT_ONESWEEP, KERNEL_ONESWEEP_HISTOGRAM, { "", "", "RadixSortOnesweepHistograms" });
+    m_kernels.onesweepScan = clContext.createKernel(PROGRAM_RADIXSORT_ONESWEEP, KERNEL_ONESWEEP_SCAN, { "RadixSortOnesweepHistograms" });
+    m_kernels.onesweepScatter = clContext.createKernel(PROGRAM_RADIXSORT_ONESWEEP, KERNEL_ONESWEEP_SCATTER,
+        { "", "RadixSortIndices", "", "RadixSortOnesweepHistograms", "", "RadixSortKeysTemp", "RadixSortIndicesTemp", "RadixSortOnesweepTileCounters", "RadixSortOnesweepLookBack" });
+
+    // Sorts keep working with the multi pass backend
+    if (!m_kernels.onesweepScatter.isValid())
+    {
+      LOG_ERROR("Failed to initialize onesweep radix sort kernels");
+      m_onesweepItems = 0;
+    }
+  }
 
-  clContext.createBuffer("RadixSortPermutateTemp", 4 * sizeof(float) * m_numEntities, CL_MEM_READ_WRITE);
+  // A failed tuning keeps the main program
+  if (!m_tuningVariants.empty())
+    tuneConfiguration();
 
+  LOG_INFO("Radix sort correctly initialized");
   return true;
 }
 
-bool RadixSort::createKernels() const
+bool RadixSort::createMultiPassKernels(MultiPassVariant& variant)
 {
-  CL::Context& clContext = CL::Context::Get();
+  CL::Context& clContext = m_context;
+
+  // Kernels of the variants are registered under their program name
+  const bool isMain = (variant.programName == PROGRAM_RADIXSORT);
+  const auto instanceName = [&](const char* kernelName)
+  { return isMain ? std::string() : variant.programName + "/" + kernelName; };
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_RESET_INDEX, { "RadixSortIndices" });
+  const size_t numGroupItems = variant.numGroups * variant.numItems;
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_HISTOGRAM, { "", "", "", "RadixSortHistogram" });
-  clContext.setKernelArg(KERNEL_HISTOGRAM, 1, sizeof(size_t), &m_numEntities);
-  clContext.setKernelArg(KERNEL_HISTOGRAM, 4, sizeof(unsigned int) * m_numRadix * m_numItems, nullptr);
+  variant.histogram = clContext.createKernel(variant.programName, KERNEL_HISTOGRAM, { "", "", "", "RadixSortHistogram" }, instanceName(KERNEL_HISTOGRAM));
+  clContext.setKernelArg(variant.histogram, 4, sizeof(unsigned int) * m_numRadix * variant.numItems, nullptr);
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_SCAN, { "RadixSortHistogram", "RadixSortSum" });
-  clContext.setKernelArg(KERNEL_SCAN, 2, sizeof(unsigned int) * std::max(m_histoSplit, m_numRadix * m_numGroups * m_numItems / m_histoSplit), nullptr);
+  variant.scan = clContext.createKernel(variant.programName, KERNEL_SCAN, { "RadixSortHistogram", "RadixSortSum" }, instanceName(KERNEL_SCAN));
+  clContext.setKernelArg(variant.scan, 2, sizeof(unsigned int) * std::max(m_histoSplit, m_numRadix * numGroupItems / m_histoSplit), nullptr);
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_MERGE, { "RadixSortSum", "RadixSortHistogram" });
+  variant.merge = clContext.createKernel(variant.programName, KERNEL_MERGE, { "RadixSortSum", "RadixSortHistogram" }, instanceName(KERNEL_MERGE));
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_REORDER, { "", "RadixSortIndices", "", "RadixSortHistogram", "", "RadixSortKeysTemp", "RadixSortIndicesTemp" });
-  clContext.setKernelArg(KERNEL_REORDER, 2, sizeof(size_t), &m_numEntities);
-  clContext.setKernelArg(KERNEL_REORDER, 7, sizeof(unsigned int) * m_numRadix * m_numItems, nullptr);
+  variant.reorder = clContext.createKernel(variant.programName, KERNEL_REORDER, { "", "RadixSortIndices", "", "RadixSortHistogram", "", "RadixSortKeysTemp", "RadixSortIndicesTemp" },
+      instanceName(KERNEL_REORDER));
+  clContext.setKernelArg(variant.reorder, 7, sizeof(unsigned int) * m_numRadix * variant.numItems, nullptr);
 
-  clContext.createKernel(PROGRAM_RADIXSORT, KERNEL_PERMUTATE, { "RadixSortIndices" });
+  return variant.histogram.isValid() && variant.scan.isValid() && variant.merge.isValid() && variant.reorder.isValid();
+}
+
+void RadixSort::useVariant(const MultiPassVariant& variant)
+{
+  m_numGroups = variant.numGroups;
+  m_numItems = variant.numItems;
+
+  m_kernels.histogram = variant.histogram;
+  m_kernels.scan = variant.scan;
+  m_kernels.merge = variant.merge;
+  m_kernels.reorder = variant.reorder;
+}
+
+bool RadixSort::tuneConfiguration()
+{
+  CL::Context& clContext = m_context;
+
+  // Same keys for every variant
+  auto rng = makeRng(std::numeric_limits<unsigned int>::max());
+  std::vector<unsigned int> keys(m_numEntities);
+  std::generate(keys.begin(), keys.end(), rng);
+
+  // Kernels of the main program are already created
+  const MultiPassVariant mainVariant { m_numGroups, m_numItems, PROGRAM_RADIXSORT, m_kernels.histogram, m_kernels.scan, m_kernels.merge, m_kernels.reorder };
+
+  const MultiPassVariant* bestVariant = nullptr;
+  double bestMs = std::numeric_limits<double>::max();
+
+  for (auto& variant : m_tuningVariants)
+  {
+    if (variant.programName == PROGRAM_RADIXSORT)
+    {
+      variant = mainVariant;
+    }
+    else if (!createMultiPassKernels(variant))
+    {
+      LOG_ERROR("Failed to initialize radix sort kernels with {} groups of {} items", variant.numGroups, variant.numItems);
+      continue;
+    }
+
+    useVariant(variant);
+    const double sortMs = timeSorts(Backend::MULTI_PASS, keys, NUM_TUNING_SORTS);
+    if (sortMs < 0.0)
+      continue;
+
+    LOG_INFO("Radix sort with {} groups of {} items: {} ms per sort", variant.numGroups, variant.numItems, sortMs);
+    if (sortMs < bestMs)
+    {
+      bestMs = sortMs;
+      bestVariant = &variant;
+    }
+  }
+
+  if (bestVariant == nullptr)
+  {
+    useVariant(mainVariant);
+    m_tuningVariants.clear();
+    LOG_ERROR("Radix sort tuning failed, using {} groups of {} items", m_numGroups, m_numItems);
+    return false;
+  }
+
+  // Kernels of the other variants stay in the context, unused
+  useVariant(*bestVariant);
+  m_tuningVariants.clear();
+
+  LOG_INFO("Radix sort tuned for {} entities: {} groups of {} items ({} ms)", m_numEntities, m_numGroups, m_numItems, bestMs);
+  return clContext.storeTuning(getTuningKey(), std::to_string(m_numGroups) + " " + std::to_string(m_numItems));
+}
+
+bool RadixSort::createDoubleBuffers(const std::vector<CL::BufferHandle>& buffers)
+{
+  CL::Context& clContext = m_context;
+
+  for (const auto& buffer : buffers)
+  {
+    if (m_buffers.twins.contains(buffer.id))
+      continue;
+
+    if (!clContext.isSwappable(buffer))
+    {
+      LOG_INFO("Radix sort cannot double buffer buffer {}, it is permutated through a copy", buffer.id);
+      continue;
+    }
+
+    const std::string twinName = "RadixSortTwin" + std::to_string(m_buffers.twins.size());
+    const CL::BufferHandle twin = clContext.createBuffer(twinName, clContext.getBufferSize(buffer), CL_MEM_READ_WRITE, "RadixSort");
+    if (!twin.isValid())
+      return false;
+
+    m_buffers.twins[buffer.id] = twin;
+
+    // Only the active range is gathered, the values after it come from the twin after a swap
+    if (!clContext.copyBuffer(buffer, twin))
+      return false;
+  }
 
   return true;
 }
 
-void RadixSort::sort(const std::string& inputKeyBufferName, const std::vector<std::string>& optionalInputBufferNames)
+void RadixSort::syncDoubleBuffers()
+{
+  CL::Context& clContext = m_context;
+
+  for (const auto& [bufferId, twin] : m_buffers.twins)
+    clContext.copyBuffer(CL::BufferHandle { bufferId }, twin);
+}
+
+void RadixSort::permutate(const std::vector<std::pair<CL::BufferHandle, CL::BufferHandle>>& permutations, size_t numEntities)
+{
+  CL::Context& clContext = m_context;
+
+  const auto& kernel = m_kernels.permutate[permutations.size() - 1];
+  for (cl_uint i = 0; i < permutations.size(); ++i)
+  {
+    clContext.setKernelArg(kernel, 2 * i + 1, permutations[i].first);
+    clContext.setKernelArg(kernel, 2 * i + 2, permutations[i].second);
+  }
+  clContext.runKernel(kernel, numEntities);
+}
+
+CL::BufferHandle RadixSort::sortIndices(CL::BufferHandle inputKeyBuffer, size_t numActiveEntities)
+{
+  sort(inputKeyBuffer, {}, numActiveEntities);
+
+  // Passes are even, the last indices written are behind the handle
+  return m_buffers.indices;
+}
+
+void RadixSort::sort(const std::string& inputKeyBufferName, const std::vector<std::string>& optionalInputBufferNames, size_t numActiveEntities)
+{
+  CL::Context& clContext = m_context;
+
+  std::vector<CL::BufferHandle> optionalInputBuffers;
+  optionalInputBuffers.reserve(optionalInputBufferNames.size());
+  for (const auto& bufferName : optionalInputBufferNames)
+    optionalInputBuffers.push_back(clContext.findBuffer(bufferName));
+
+  sort(clContext.findBuffer(inputKeyBufferName), optionalInputBuffers, numActiveEntities);
+}
+
+void RadixSort::sort(CL::BufferHandle inputKeyBuffer, const std::vector<CL::BufferHandle>& optionalInputBuffers, size_t numActiveEntities)
 {
   // First sorting main input key buffer
   // Then sorting optional input buffers based on indices permutation of the main input key buffer
 
-  CL::Context& clContext = CL::Context::Get();
+  CL::Context& clContext = m_context;
+
+  // Every kernel works on the active range only, sort cost follows the actual number of entities
+  const size_t numEntities = std::min(numActiveEntities, m_numEntities);
+  if (numEntities == 0)
+    return;
+
+  sortKeys(inputKeyBuffer, numEntities, m_backend);
+
+  // Double buffered values are gathered into their twins by fused launches, then swapped in: no copy at all
+  std::vector<std::pair<CL::BufferHandle, CL::BufferHandle>> toTwins;
+  for (const auto& bufferToPermutate : optionalInputBuffers)
+  {
+    const auto twin = m_buffers.twins.find(bufferToPermutate.id);
+    if (twin != m_buffers.twins.end())
+    {
+      toTwins.emplace_back(bufferToPermutate, twin->second);
+      continue;
+    }
+
+    clContext.copyBuffer(bufferToPermutate, m_buffers.permutateTemp, 4 * sizeof(float) * numEntities);
+    permutate({ { m_buffers.permutateTemp, bufferToPermutate } }, numEntities);
+  }
+
+  for (size_t first = 0; first < toTwins.size(); first += MAX_FUSED_PERMUTATIONS)
+  {
+    const size_t last = std::min(first + MAX_FUSED_PERMUTATIONS, toTwins.size());
+    permutate({ toTwins.begin() + first, toTwins.begin() + last }, numEntities);
+
+    for (size_t i = first; i < last; ++i)
+      clContext.swapBuffers(toTwins[i].first, toTwins[i].second);
+  }
+}
+
+void RadixSort::sortKeys(CL::BufferHandle inputKeyBuffer, size_t numEntities, Backend backend)
+{
+  // Passes are even, the caller buffer ends up behind its handle again, its inactive tail never written
+  if (backend == Backend::ONESWEEP && isOnesweepSupported())
+    sortKeysOnesweep(inputKeyBuffer, numEntities);
+  else
+    sortKeysMultiPass(inputKeyBuffer, numEntities);
+}
+
+void RadixSort::sortKeysMultiPass(CL::BufferHandle inputKeyBuffer, size_t numEntities)
+{
+  CL::Context& clContext = m_context;
 
   size_t totalScan = m_numRadix * m_numGroups * m_numItems / 2;
   size_t localScan = totalScan / m_histoSplit;
 
-  clContext.runKernel(KERNEL_RESET_INDEX, m_numEntities);
+  clContext.runKernel(m_kernels.resetIndex, numEntities);
+
+  clContext.setKernelArg(m_kernels.histogram, 1, sizeof(size_t), &numEntities);
+  clContext.setKernelArg(m_kernels.reorder, 2, sizeof(size_t), &numEntities);
+
+  for (int radixPass = 0; radixPass < m_numRadixPasses; ++radixPass)
+  {
+    clContext.setKernelArg(m_kernels.histogram, 0, inputKeyBuffer);
+    clContext.setKernelArg(m_kernels.histogram, 2, sizeof(radixPass), &radixPass);
+    clContext.runKernel(m_kernels.histogram, m_numGroups * m_numItems, m_numItems);
+
+    clContext.setKernelArg(m_kernels.scan, 0, m_buffers.histogram);
+    clContext.setKernelArg(m_kernels.scan, 1, m_buffers.sum);
+    clContext.runKernel(m_kernels.scan, totalScan, localScan);
+
+    clContext.setKernelArg(m_kernels.scan, 0, m_buffers.sum);
+    clContext.setKernelArg(m_kernels.scan, 1, m_buffers.tempSum);
+    clContext.runKernel(m_kernels.scan, m_histoSplit / 2, m_histoSplit / 2);
+
+    clContext.runKernel(m_kernels.merge, totalScan, localScan);
+
+    clContext.setKernelArg(m_kernels.reorder, 0, inputKeyBuffer);
+    clContext.setKernelArg(m_kernels.reorder, 1, m_buffers.indices);
+    clContext.setKernelArg(m_kernels.reorder, 5, m_buffers.keysTemp);
+    clContext.setKernelArg(m_kernels.reorder, 6, m_buffers.indicesTemp);
+    clContext.setKernelArg(m_kernels.reorder, 4, sizeof(radixPass), &radixPass);
+    clContext.runKernel(m_kernels.reorder, m_numGroups * m_numItems, m_numItems);
+
+    clContext.swapBuffers(inputKeyBuffer, m_buffers.keysTemp);
+    clContext.swapBuffers(m_buffers.indices, m_buffers.indicesTemp);
+  }
+}
+
+size_t RadixSort::getOnesweepNumTiles(size_t numEntities) const
+{
+  const size_t tileSize = m_onesweepItems * m_onesweepKeysPerItem;
+  return (tileSize > 0) ? (numEntities + tileSize - 1) / tileSize : 0;
+}
+
+void RadixSort::sortKeysOnesweep(CL::BufferHandle inputKeyBuffer, size_t numEntities)
+{
+  CL::Context& clContext = m_context;
+
+  const size_t numTiles = getOnesweepNumTiles(numEntities);
+
+  // Look-back status of the tiles of this sort only
+  clContext.runKernel(m_kernels.onesweepClear, m_numRadixPasses * numTiles * m_numRadix);
+
+  // Digits of all passes in one read of the keys, then scanned to the first position of each digit
+  clContext.setKernelArg(m_kernels.onesweepHistogram, 0, inputKeyBuffer);
+  clContext.setKernelArg(m_kernels.onesweepHistogram, 1, sizeof(size_t), &numEntities);
+  clContext.runKernel(m_kernels.onesweepHistogram, std::min<size_t>(numTiles, m_numGroups) * m_onesweepItems, m_onesweepItems);
+  clContext.runKernel(m_kernels.onesweepScan, m_numRadixPasses * m_numRadix, m_numRadix);
 
+  // First pass starts from the identity permutation, no index reset needed
+  clContext.setKernelArg(m_kernels.onesweepScatter, 2, sizeof(size_t), &numEntities);
   for (int radixPass = 0; radixPass < m_numRadixPasses; ++radixPass)
   {
-    clContext.setKernelArg(KERNEL_HISTOGRAM, 0, inputKeyBufferName);
-    clContext.setKernelArg(KERNEL_HISTOGRAM, 2, sizeof(radixPass), &radixPass);
-    clContext.runKernel(KERNEL_HISTOGRAM, m_numGroups * m_numItems, m_numItems);
+    clContext.setKernelArg(m_kernels.onesweepScatter, 0, inputKeyBuffer);
+    clContext.setKernelArg(m_kernels.onesweepScatter, 1, m_buffers.indices);
+    clContext.setKernelArg(m_kernels.onesweepScatter, 4, sizeof(radixPass), &radixPass);
+    clContext.setKernelArg(m_kernels.onesweepScatter, 5, m_buffers.keysTemp);
+    clContext.setKernelArg(m_kernels.onesweepScatter, 6, m_buffers.indicesTemp);
+    clContext.runKernel(m_kernels.onesweepScatter, numTiles * m_onesweepItems, m_onesweepItems);
+
+    clContext.swapBuffers(inputKeyBuffer, m_buffers.keysTemp);
+    clContext.swapBuffers(m_buffers.indices, m_buffers.indicesTemp);
+  }
+}
+
+bool RadixSort::setBackend(Backend backend)
+{
+  if (backend == Backend::ONESWEEP && !isOnesweepSupported())
+  {
+    LOG_ERROR("Onesweep radix sort not supported by this device");
+    return false;
+  }
 
-    clContext.setKernelArg(KERNEL_SCAN, 0, "RadixSortHistogram");
-    clContext.setKernelArg(KERNEL_SCAN, 1, "RadixSortSum");
-    clContext.runKernel(KERNEL_SCAN, totalScan, localScan);
+  m_backend = backend;
+  return true;
+}
 
-    clContext.setKernelArg(KERNEL_SCAN, 0, "RadixSortSum");
-    clContext.setKernelArg(KERNEL_SCAN, 1, "RadixSortTempSum");
-    clContext.runKernel(KERNEL_SCAN, m_histoSplit / 2, m_histoSplit / 2);
+double RadixSort::benchmark(Backend backend, size_t numEntities, int numSorts)
+{
+  numEntities = std::min(numEntities, m_numEntities);
+  if (numEntities == 0 || numSorts <= 0 || (backend == Backend::ONESWEEP && !isOnesweepSupported()))
+    return -1.0;
 
-    clContext.runKernel(KERNEL_MERGE, totalScan, localScan);
+  auto rng = makeRng(std::numeric_limits<unsigned int>::max());
+  std::vector<unsigned int> keys(numEntities);
+  std::generate(keys.begin(), keys.end(), rng);
 
-    clContext.setKernelArg(KERNEL_REORDER, 0, inputKeyBufferName);
-    clContext.setKernelArg(KERNEL_REORDER, 1, "RadixSortIndices");
-    clContext.setKernelArg(KERNEL_REORDER, 5, "RadixSortKeysTemp");
-    clContext.setKernelArg(KERNEL_REORDER, 6, "RadixSortIndicesTemp");
-    clContext.setKernelArg(KERNEL_REORDER, 4, sizeof(radixPass), &radixPass);
-    clContext.runKernel(KERNEL_REORDER, m_numGroups * m_numItems, m_numItems);
+  return timeSorts(backend, keys, numSorts);
+}
 
-    clContext.swapBuffers(inputKeyBufferName, "RadixSortKeysTemp");
-    clContext.swapBuffers("RadixSortIndices", "RadixSortIndicesTemp");
+double RadixSort::timeSorts(Backend backend, const std::vector<unsigned int>& keys, int numSorts)
+{
+  CL::Context& clContext = m_context;
+
+  const size_t numEntities = keys.size();
+
+  if (!m_buffers.benchmarkKeys.isValid())
+    m_buffers.benchmarkKeys = clContext.createBuffer("RadixSortBenchmarkKeys", sizeof(unsigned int) * m_numEntities, CL_MEM_READ_WRITE, "RadixSort");
+
+  double totalMs = 0.0;
+  for (int i = 0; i < numSorts; ++i)
+  {
+    clContext.loadBufferFromHost(m_buffers.benchmarkKeys, 0, sizeof(unsigned int) * numEntities, keys.data());
+    clContext.finishTasks();
+
+    const auto start = std::chrono::steady_clock::now();
+    sortKeys(m_buffers.benchmarkKeys, numEntities, backend);
+    clContext.finishTasks();
+    totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
   }
 
-  for (const auto& bufferToPermutate : optionalInputBufferNames)
+  std::vector<unsigned int> sortedKeys(numEntities);
+  std::vector<unsigned int> permutation(numEntities);
+  clContext.unloadBufferFromDevice(m_buffers.benchmarkKeys, 0, sizeof(unsigned int) * numEntities, sortedKeys.data());
+  clContext.unloadBufferFromDevice(m_buffers.indices, 0, sizeof(unsigned int) * numEntities, permutation.data());
+
+  const auto unsortedKey = std::is_sorted_until(sortedKeys.begin(), sortedKeys.end());
+  if (unsortedKey != sortedKeys.end())
   {
-    clContext.copyBuffer(bufferToPermutate, "RadixSortPermutateTemp");
-    clContext.setKernelArg(KERNEL_PERMUTATE, 1, "RadixSortPermutateTemp");
-    clContext.setKernelArg(KERNEL_PERMUTATE, 2, bufferToPermutate);
-    clContext.runKernel(KERNEL_PERMUTATE, m_numEntities);
+    LOG_ERROR("Radix sort of {} entities with {} groups of {} items gave unsorted keys from index {}", numEntities, m_numGroups, m_numItems, std::distance(sortedKeys.begin(), unsortedKey));
+    return -1.0;
   }
-}
\ No newline at end of file
+
+  size_t firstMismatch = 0;
+  if (!checkPermutation(sortedKeys, keys, permutation, firstMismatch))
+  {
+    LOG_ERROR("Radix sort of {} entities with {} groups of {} items gave a wrong permutation from index {}", numEntities, m_numGroups, m_numItems, firstMismatch);
+    return -1.0;
+  }
+
+  return totalMs / numSorts;
+}
@@ -1,52 +1,114 @@
 #pragma once
 
+#include "../ocl/Handles.hpp"
+
 #include <array>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include <algorithm>
-#include <chrono>
-#include <random>
-#include <iostream>
-
 namespace Physics
 {
-template <typename T, typename U>
-bool checkPermutation(const std::vector<T>& keysAfterSort,
-    const std::vector<T>& keysBeforeSort,
-    const std::vector<U>& permutation)
+namespace CL
 {
-  for (size_t i = 0; i < keysAfterSort.size(); ++i)
-  {
-    if (keysBeforeSort[permutation[i]] != keysAfterSort[i])
-    {
-      std::cout << i << " " << keysAfterSort[i] << " " << keysBeforeSort[i] << " " << permutation[i] << std::endl;
-      return false;
-    }
-  }
-  return true;
+class Context;
 }
 
-template <typename T>
-auto makeRng(T upperBound)
-{
-  return std::linear_congruential_engine<T, std::minstd_rand::multiplier, std::minstd_rand::increment, std::minstd_rand::modulus> {
-    static_cast<T>(std::chrono::steady_clock::now().time_since_epoch().count())
-  };
-}
 class RadixSort
 {
   public:
-  RadixSort(size_t numEntities);
+  // MULTI_PASS : histogram, scans, merge and reorder for each digit
+  // ONESWEEP : histograms of all digits at once, then a single scatter per digit chained by a decoupled look-back
+  enum class Backend
+  {
+    MULTI_PASS,
+    ONESWEEP
+  };
+
+  // Only starts the program build, createKernels() must be called before sorting
+  // With an alias group, the permutation scratch buffer is taken from the context arena, which the owner must allocate
+  RadixSort(CL::Context& context, size_t numEntities, const std::string& scratchAliasGroup = "");
   ~RadixSort() = default;
 
-  void sort(const std::string& inputKeyBufferName, const std::vector<std::string>& optionalInputBufferNames = {});
+  // Waits for the program builds. While tuning, every program variant is timed here and the fastest one is kept
+  bool createKernels();
+
+  // Values sorted along the keys are gathered into a twin buffer of the same size, swapped in afterwards.
+  // Kernels bound to the buffer follow the swap. Without a twin, buffers are copied aside and gathered back in place.
+  // Buffers which cannot be swapped are ignored. Twins start as a copy of their buffer
+  bool createDoubleBuffers(const std::vector<CL::BufferHandle>& buffers);
+  // Copies the whole double buffered values into their twins, needed after they are written outside of a sort
+  void syncDoubleBuffers();
+
+  static constexpr size_t ALL_ENTITIES = std::numeric_limits<size_t>::max();
+
+  // Only the first numActiveEntities keys and values are sorted, the ones after them are left untouched
+  void sort(CL::BufferHandle inputKeyBuffer, const std::vector<CL::BufferHandle>& optionalInputBuffers = {}, size_t numActiveEntities = ALL_ENTITIES);
+  void sort(const std::string& inputKeyBufferName, const std::vector<std::string>& optionalInputBufferNames = {}, size_t numActiveEntities = ALL_ENTITIES);
+
+  // Index indirection, only the keys are sorted: values stay in place, the one at sorted position i is at index indices[i].
+  // Returns the sorted indices buffer, overwritten by the next sort
+  CL::BufferHandle sortIndices(CL::BufferHandle inputKeyBuffer, size_t numActiveEntities = ALL_ENTITIES);
+  // Sorted indices of the last sort
+  CL::BufferHandle getSortedIndices() const { return m_buffers.indices; }
+
+  // Multi pass by default. Onesweep relies on fair scheduling of work groups, which OpenCL 1.2 does not guarantee,
+  // it is only used when explicitly asked for. Kept to multi pass if the device cannot run onesweep.
+  // Tuning only measures multi pass
+  bool setBackend(Backend backend);
+  Backend getBackend() const { return m_backend; }
+  // Enough local memory for its tiles, says nothing about forward progress of its look-back
+  bool isOnesweepSupported() const { return m_onesweepItems > 0; }
+
+  // Mean time in ms of numSorts sorts of numEntities random keys, checked afterwards. Negative if the keys are not sorted
+  double benchmark(Backend backend, size_t numEntities, int numSorts);
 
   private:
+  // Program built for a number of groups and items, with the kernels depending on them
+  struct MultiPassVariant
+  {
+    unsigned int numGroups;
+    unsigned int numItems;
+    std::string programName;
+    CL::KernelHandle histogram;
+    CL::KernelHandle scan;
+    CL::KernelHandle merge;
+    CL::KernelHandle reorder;
+  };
+
   bool createProgram() const;
-  bool createBuffers() const;
-  bool createKernels() const;
+  std::string getBuildOptions(unsigned int numGroups, unsigned int numItems) const;
+  bool createBuffers();
+
+  bool createMultiPassKernels(MultiPassVariant& variant);
+  void useVariant(const MultiPassVariant& variant);
+
+  // Keys and indices only, with the given backend
+  void sortKeys(CL::BufferHandle inputKeyBuffer, size_t numEntities, Backend backend);
+  void sortKeysMultiPass(CL::BufferHandle inputKeyBuffer, size_t numEntities);
+  void sortKeysOnesweep(CL::BufferHandle inputKeyBuffer, size_t numEntities);
+  size_t getOnesweepNumTiles(size_t numEntities) const;
+
+  // Gathers float4 values of each (input, output) pair, up to MAX_FUSED_PERMUTATIONS pairs in one launch
+  void permutate(const std::vector<std::pair<CL::BufferHandle, CL::BufferHandle>>& permutations, size_t numEntities);
+
+  // Mean time in ms of numSorts sorts of the keys, checked afterwards. Negative if the keys are not sorted
+  double timeSorts(Backend backend, const std::vector<unsigned int>& keys, int numSorts);
+
+  // Groups and items are compile-time constants of the program: while tuning, one program is built per configuration
+  void selectConfiguration();
+  bool isValidConfiguration(unsigned int numGroups, unsigned int numItems) const;
+  std::string getTuningKey() const;
+  // Times every variant once the kernels are created, uses and stores the fastest one
+  bool tuneConfiguration();
+
+  // Context of the owning model, programs, kernels and buffers are created in it
+  CL::Context& m_context;
 
   size_t m_numEntities;
+  std::string m_scratchAliasGroup;
 
   unsigned int m_numRadix;
 
@@ -61,5 +123,46 @@ class RadixSort
   int m_numRadixPasses;
 
   std::vector<unsigned int> m_indices;
+
+  // Every valid configuration while tuning, empty otherwise
+  std::vector<MultiPassVariant> m_tuningVariants;
+
+  Backend m_backend;
+  // Work items of a onesweep tile, 0 if onesweep does not fit the device
+  unsigned int m_onesweepItems;
+  unsigned int m_onesweepKeysPerItem;
+
+  struct
+  {
+    CL::KernelHandle resetIndex;
+    CL::KernelHandle histogram;
+    CL::KernelHandle scan;
+    CL::KernelHandle merge;
+    CL::KernelHandle reorder;
+    // Per number of fused permutations, minus one
+    std::array<CL::KernelHandle, 4> permutate;
+    CL::KernelHandle onesweepClear;
+    CL::KernelHandle onesweepHistogram;
+    CL::KernelHandle onesweepScan;
+    CL::KernelHandle onesweepScatter;
+  } m_kernels;
+
+  struct
+  {
+    CL::BufferHandle keysTemp;
+    CL::BufferHandle histogram;
+    CL::BufferHandle sum;
+    CL::BufferHandle tempSum;
+    CL::BufferHandle indices;
+    CL::BufferHandle indicesTemp;
+    CL::BufferHandle permutateTemp;
+    // Buffer id -> twin
+    std::unordered_map<uint32_t, CL::BufferHandle> twins;
+    CL::BufferHandle onesweepHistograms;
+    CL::BufferHandle onesweepTileCounters;
+    CL::BufferHandle onesweepLookBack;
+    // Created by the first timed sorts
+    CL::BufferHandle benchmarkKeys;
+  } m_buffers;
 };
 }
\ No newline at end of file
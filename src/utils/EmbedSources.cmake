@@ -0,0 +1,36 @@
+# Generate a translation unit embedding kernel and shader sources, run at build time with cmake -P
+#
+# Expected variables : SOURCES (;-separated absolute paths), ROOT_DIR (paths are stored relative to it), OUTPUT
+
+# MSVC rejects string literals longer than 16K, sources are split in adjacent literals
+set(CHUNK_SIZE 8000)
+
+file(WRITE ${OUTPUT}.tmp "// Generated by EmbedSources.cmake from kernel and shader sources, do not edit\n\n")
+file(APPEND ${OUTPUT}.tmp "#include \"EmbeddedSources.h\"\n\nnamespace\n{\n")
+file(APPEND ${OUTPUT}.tmp "constexpr Utils::EmbeddedSource EMBEDDED_SOURCES[] = {\n")
+
+foreach(SOURCE ${SOURCES})
+  get_filename_component(SOURCE_NAME ${SOURCE} NAME)
+  file(RELATIVE_PATH SOURCE_RELATIVE_PATH ${ROOT_DIR} ${SOURCE})
+  file(READ ${SOURCE} SOURCE_CODE)
+  string(LENGTH "${SOURCE_CODE}" SOURCE_LENGTH)
+
+  file(APPEND ${OUTPUT}.tmp "    {\"${SOURCE_NAME}\", \"${SOURCE_RELATIVE_PATH}\",\n")
+  set(OFFSET 0)
+  while(OFFSET LESS SOURCE_LENGTH)
+    string(SUBSTRING "${SOURCE_CODE}" ${OFFSET} ${CHUNK_SIZE} CHUNK)
+    file(APPEND ${OUTPUT}.tmp "     R\"__EMBED__(${CHUNK})__EMBED__\"\n")
+    math(EXPR OFFSET "${OFFSET} + ${CHUNK_SIZE}")
+  endwhile()
+  if(SOURCE_LENGTH EQUAL 0)
+    file(APPEND ${OUTPUT}.tmp "     \"\"\n")
+  endif()
+  file(APPEND ${OUTPUT}.tmp "    },\n")
+endforeach()
+
+file(APPEND ${OUTPUT}.tmp "};\n}\n\n")
+file(APPEND ${OUTPUT}.tmp "std::span<const Utils::EmbeddedSource> Utils::GetEmbeddedSources()\n{\n    return EMBEDDED_SOURCES;\n}\n")
+
+# Avoid recompiling the translation unit if nothing changed
+file(COPY_FILE ${OUTPUT}.tmp ${OUTPUT} ONLY_IF_DIFFERENT)
+file(REMOVE ${OUTPUT}.tmp)
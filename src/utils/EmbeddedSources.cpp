@@ -0,0 +1,38 @@
+//
+// Kernel and shader sources compiled into the executable
+//
+
+#include "EmbeddedSources.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace Utils {
+
+    std::string LoadSource(std::string_view name) {
+        const auto sources = GetEmbeddedSources();
+        const auto it = std::find_if(sources.begin(), sources.end(),
+                                     [name](const EmbeddedSource &source) { return source.name == name; });
+
+        if (it == sources.end()) {
+            LOG_ERROR("No embedded source named {}", name);
+            return "";
+        }
+
+        // Development override, read at each call so edited files are picked up on engine reset
+        if (const char *overrideDir = std::getenv("FLUID_SIM_SOURCES_DIR")) {
+            const auto path = std::filesystem::path(overrideDir) / it->relativePath;
+            std::ifstream sourceFile(path);
+            if (sourceFile.is_open()) {
+                LOG_INFO("Loading {} from override directory", path.string());
+                return std::string(std::istreambuf_iterator<char>(sourceFile), std::istreambuf_iterator<char>());
+            }
+        }
+
+        return std::string(it->source);
+    }
+}
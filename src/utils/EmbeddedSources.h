@@ -0,0 +1,26 @@
+//
+// Kernel and shader sources compiled into the executable
+//
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace Utils
+{
+    struct EmbeddedSource {
+        std::string_view name;
+        // Relative to the repository root, used to find it in the override directory
+        std::string_view relativePath;
+        std::string_view source;
+    };
+
+    // All the embedded sources, generated at build time
+    std::span<const EmbeddedSource> GetEmbeddedSources();
+
+    // Source of a kernel or shader file from its name (ex: "fluids.cl").
+    // If FLUID_SIM_SOURCES_DIR environment variable is set, the file is first read from this directory,
+    // handy to iterate on kernels without rebuilding. Empty if not found.
+    std::string LoadSource(std::string_view name);
+}
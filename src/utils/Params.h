@@ -43,10 +43,13 @@ namespace Utils {
     };
 
 // Length of one side of the bounding box where the particles evolve
-    static constexpr int BOX_SIZE = 10;
+    static constexpr int BOX_SIZE = SCENE_BOX_SIZE;
 
 // Length of one side of the cells forming the 3D grid containing all the particles
-    static constexpr int GRID_RES = 30; // default = 30
+    static constexpr int GRID_RES = SCENE_GRID_RES; // default = 30
+
+// Resolution of the TSDF grid of the mesher
+    static constexpr int TSDF_GRID_RES = SCENE_TSDF_GRID_RES; // default = 3 * GRID_RES
 
     static std::array<int, 3> GetNbParticlesSubdiv3D(NbParticles nbParts)
     {
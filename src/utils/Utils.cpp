@@ -3,10 +3,18 @@
 //
 
 #include "Utils.h"
+#include <filesystem>
 #include <iomanip>
 #include <ostream>
 #include <sstream>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
 namespace Utils {
 
     std::string FloatToStr(float val, size_t precision) {
@@ -18,4 +26,28 @@ namespace Utils {
     std::string Utils::GetSrcDir() {
         return std::string(SOURCE_DIR);
     }
+
+    std::string GetExecutableDir() {
+        std::filesystem::path executablePath;
+        std::error_code error;
+#if defined(_WIN32)
+        char buffer[MAX_PATH];
+        const DWORD length = GetModuleFileNameA(nullptr, buffer, MAX_PATH);
+        if (length > 0 && length < MAX_PATH)
+            executablePath = std::string(buffer, length);
+#elif defined(__APPLE__)
+        char buffer[1024];
+        uint32_t size = sizeof(buffer);
+        if (_NSGetExecutablePath(buffer, &size) == 0)
+            executablePath = std::filesystem::canonical(buffer, error);
+#elif defined(__linux__)
+        executablePath = std::filesystem::read_symlink("/proc/self/exe", error);
+#endif
+
+        // Launch directory as a last resort
+        if (executablePath.empty() || error)
+            return ".";
+
+        return executablePath.parent_path().string();
+    }
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 namespace Utils
 {
     std::string GetSrcDir();
+    // Directory of the running executable, "." if it cannot be found
+    std::string GetExecutableDir();
     std::string FloatToStr(float val, size_t precision = 10);
 }
 